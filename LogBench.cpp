@@ -0,0 +1,963 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <fstream>
+#include <cstdlib>
+#include <new>
+
+#include <deque>
+#include <queue>
+
+#include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "date/date.h"
+#include "log_message.h"
+#include "log_manager.h"
+#include "log_config.h"
+
+//! Every heap allocation made by the process, see benchAllocations()
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if(void *ptr = std::malloc(size))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+//! Log back end that throws messages away, so only the cost of getting a message to the manager is measured
+class nullTarget : public LogXX::logTarget
+{
+    public:
+        void LogMessage(std::shared_ptr<LogXX::message>) override
+        {
+            ++m_count;
+        }
+
+        std::atomic<uint64_t> m_count{0};
+};
+
+//! Log back end that takes `delay` for every message, standing in for a compressor or a slow network sink
+class slowTarget : public LogXX::logTarget
+{
+    public:
+        explicit slowTarget(std::chrono::microseconds delay) : m_delay(delay)
+        {
+        }
+
+        void LogMessage(std::shared_ptr<LogXX::message>) override
+        {
+            std::this_thread::sleep_for(m_delay);
+        }
+
+    private:
+        std::chrono::microseconds m_delay;
+};
+
+//! Log back end that writes through `boost::filesystem::ofstream`, the way logFile did before it was buffered
+class ofstreamTarget : public LogXX::logTarget
+{
+    public:
+        explicit ofstreamTarget(const boost::filesystem::path &logFile) : m_file(logFile)
+        {
+        }
+
+        void LogMessage(std::shared_ptr<LogXX::message> msg) override
+        {
+            m_file << msg << std::endl;
+        }
+
+    private:
+        boost::filesystem::ofstream m_file;
+};
+
+//! Producer side latency of `_trace` with `threads` threads each logging `count` messages
+void benchProducerLatency(unsigned threads, unsigned count)
+{
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto target(std::make_shared<nullTarget>());
+    logManager->addTarget(target);
+    logManager->Run();
+
+    std::vector<std::vector<std::chrono::nanoseconds>> latencies(threads);
+    std::vector<std::thread> producers;
+    std::atomic<bool> go(false);
+
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        producers.emplace_back([&, t]
+        {
+            auto &samples(latencies[t]);
+            samples.reserve(count);
+
+            while(!go)
+            {
+                std::this_thread::yield();
+            }
+
+            for(unsigned i = 0; i < count; ++i)
+            {
+                auto start(std::chrono::steady_clock::now());
+                _trace("benchmark %1% %2%", t, i);
+                samples.push_back(std::chrono::steady_clock::now() - start);
+            }
+        });
+    }
+
+    auto start(std::chrono::steady_clock::now());
+    go = true;
+
+    for(auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+    logManager->Shutdown();
+
+    std::vector<std::chrono::nanoseconds> all;
+
+    for(const auto &samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+
+    std::sort(all.begin(), all.end());
+
+    auto percentile([&all](double p)
+    {
+        return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))].count();
+    });
+
+    std::cout << boost::format("producers %|3| messages %|9| p50 %|7|ns p99 %|7|ns p99.9 %|8|ns max %|9|ns %|10.0f| msgs/sec logged %|9|\n")
+              % threads
+              % all.size()
+              % percentile(0.50)
+              % percentile(0.99)
+              % percentile(0.999)
+              % all.back().count()
+              % (all.size() / std::chrono::duration<double>(elapsed).count())
+              % target->m_count;
+}
+
+//! Cost of a `_trace` call site that the configuration disables
+void benchDisabledCallsite(unsigned count)
+{
+    auto configFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.json"));
+    std::ofstream(configFile.string()) << R"({ "level": "info" })";
+
+    auto logManager(std::make_shared<LogXX::manager>(configFile));
+    logManager->addTarget(std::make_shared<nullTarget>());
+    logManager->Run();
+
+    unsigned evaluated(0);
+    auto argument([&evaluated]
+    {
+        return ++evaluated;
+    });
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        _trace("disabled %1%", argument());
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+    logManager->Shutdown();
+    boost::filesystem::remove(configFile);
+
+    // The first call resolves the call site, so it is the only one that evaluates its arguments
+    std::cout << boost::format("disabled _trace %|6.2f|ns/call, arguments evaluated %|| times\n")
+              % (std::chrono::duration<double, std::nano>(elapsed).count() / count)
+              % evaluated;
+}
+
+//! The call site benchRateLimited() limits, `__func__` in the producer lambdas would be "operator()"
+template <typename Argument>
+void rateLimitedSite(Argument &argument)
+{
+    _err("flooding %1%", argument());
+}
+
+//! Cost of an `_err` call site flooding past its rate limit from `threads` threads at once
+void benchRateLimited(unsigned threads, unsigned count)
+{
+    auto configFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.json"));
+    std::ofstream(configFile.string()) << R"({ "level": "info", "function": { "name": "rateLimitedSite", "rate": "1000", "burst": "100" } })";
+
+    auto logManager(std::make_shared<LogXX::manager>(configFile));
+    auto target(std::make_shared<nullTarget>());
+    logManager->addTarget(target);
+    logManager->Run();
+
+    std::atomic<unsigned> evaluated(0);
+    auto argument([&evaluated]
+    {
+        return evaluated.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    std::vector<std::thread> producers;
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        producers.emplace_back([&argument, count]
+        {
+            for(unsigned i = 0; i < count; ++i)
+            {
+                rateLimitedSite(argument);
+            }
+        });
+    }
+
+    for(auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+    logManager->Shutdown();
+    boost::filesystem::remove(configFile);
+
+    // Delivered is what got through plus the "suppressed" summaries, arguments are only evaluated for those that got through
+    std::cout << boost::format("%|2| threads: %|6.2f|ns/call, %|| of %|| calls delivered, arguments evaluated %|| times\n")
+              % threads
+              % (std::chrono::duration<double, std::nano>(elapsed).count() / count)
+              % target->m_count
+              % (static_cast<uint64_t>(count) * threads)
+              % evaluated;
+}
+
+//! Heap allocations per message, on every thread, once the message pool has warmed up
+void benchAllocations(unsigned count)
+{
+    auto logManager(std::make_shared<LogXX::manager>());
+    logManager->addTarget(std::make_shared<nullTarget>());
+    logManager->Run();
+
+    auto logBatch([count]
+    {
+        for(unsigned i = 0; i < count; ++i)
+        {
+            _trace("allocations %1% %2% %3%", i, 3.14, "text");
+
+            // Stay well under the pool size so messages make it back before the next one is needed
+            if(i % 256 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+
+    logBatch();
+    uint64_t before(g_allocations.load());
+    logBatch();
+    uint64_t after(g_allocations.load());
+
+    logManager->Shutdown();
+
+    std::cout << boost::format("%|.2f| allocations per message\n") % (static_cast<double>(after - before) / count);
+}
+
+//! Producer cost of the format and stream macros for the same message, and what the stream macros allocate
+void benchStreaming(unsigned count)
+{
+    auto configFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.json"));
+    std::ofstream(configFile.string()) << R"({ "level": "info" })";
+
+    // Room for every message, so producers never wait for the log thread
+    auto logManager(std::make_shared<LogXX::manager>(configFile, count * 2));
+    logManager->addTarget(std::make_shared<nullTarget>());
+    logManager->Run();
+
+    std::string peer("10.0.0.1:443");
+
+    auto timed([count](auto log)
+    {
+        auto start(std::chrono::steady_clock::now());
+
+        for(unsigned i = 0; i < count; ++i)
+        {
+            log(i);
+        }
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    });
+
+    // Once to warm up the message pool and the call sites
+    for(int round = 0; round < 2; ++round)
+    {
+        timed([&peer](unsigned i) { _info("request %1% took %2%ms from %3%", i, i * 0.25, peer); });
+        timed([&peer](unsigned i) { _info_s << "request " << i << " took " << i * 0.25 << "ms from " << peer; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    double format(timed([&peer](unsigned i) { _info("request %1% took %2%ms from %3%", i, i * 0.25, peer); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint64_t before(g_allocations.load());
+    double stream(timed([&peer](unsigned i) { _info_s << "request " << i << " took " << i * 0.25 << "ms from " << peer; }));
+    uint64_t allocations(g_allocations.load() - before);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    unsigned evaluated(0);
+    double disabled(timed([&evaluated](unsigned) { _trace_s << "disabled " << ++evaluated; }));
+
+    logManager->Shutdown();
+    boost::filesystem::remove(configFile);
+
+    std::cout << boost::format("3 argument message, _info %|7.1f|ns/call _info_s %|7.1f|ns/call, %|.2f| allocations per streamed message\n")
+              % format
+              % stream
+              % (static_cast<double>(allocations) / count);
+    std::cout << boost::format("disabled _trace_s %|6.2f|ns/call, arguments evaluated %|| times\n") % disabled % evaluated;
+}
+
+//! Messages reaching a fast back end while a slow one is attached, with the slow one inline or on its own thread
+void benchSlowTarget(bool ownThread, unsigned count)
+{
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto fast(std::make_shared<nullTarget>());
+    logManager->addTarget(fast);
+    logManager->addTarget(std::make_shared<slowTarget>(std::chrono::microseconds(50)), ownThread);
+    logManager->Run();
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        _trace("fan out %1%", i);
+    }
+
+    while(fast->m_count < count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+
+    std::cout << boost::format("slow target %|-10| fast target done after %|8.1f|ms\n")
+              % (ownThread ? "threaded" : "inline")
+              % std::chrono::duration<double, std::milli>(elapsed).count();
+
+    for(const auto &stats : logManager->getTargetStats())
+    {
+        std::cout << boost::format("    %|-10| backlog %|6| delivered %|6| lag %|8.1f|ms\n")
+                  % (stats.ownThread ? "threaded" : "inline")
+                  % stats.backlog
+                  % stats.delivered
+                  % std::chrono::duration<double, std::milli>(stats.lag).count();
+    }
+
+    logManager->Shutdown();
+}
+
+//! What each overflow policy costs producers when the only back end can't keep up
+void benchOverflow(LogXX::overflowPolicy policy, const std::string &name, unsigned count, bool ownThread = false)
+{
+    auto logManager(std::make_shared<LogXX::manager>(boost::filesystem::path(), 256));
+    auto slow(std::make_shared<slowTarget>(std::chrono::microseconds(20)));
+    logManager->setOverflowPolicy(policy, LogXX::LOG_WARNING);
+    logManager->addTarget(slow, ownThread);
+    logManager->Run();
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        if(i % 10 == 0)
+        {
+            _warn("overflow %1%", i);
+        }
+        else
+        {
+            _trace("overflow %1%", i);
+        }
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+    auto stats(logManager->getTargetStats());
+    logManager->Shutdown();
+
+    // A threaded back end drops whole batches of its own when it falls behind the log thread
+    std::cout << boost::format("%|-18| producers took %|8.1f|ms dropped %|7| blocked %|7| back end dropped %|7|\n")
+              % name
+              % std::chrono::duration<double, std::milli>(elapsed).count()
+              % logManager->getDropped()
+              % logManager->getBlocked()
+              % stats.front().dropped;
+}
+
+//! The configuration walk from before rules were compiled, kept to compare against
+LogXX::levels legacyLevel(const boost::property_tree::ptree &configuration, const std::shared_ptr<LogXX::message> msg)
+{
+    LogXX::levels level(LogXX::LOG_ALL);
+
+    std::queue<boost::property_tree::ptree> treeQueue;
+    treeQueue.push(configuration);
+
+    while(!treeQueue.empty())
+    {
+        auto &node(treeQueue.front());
+
+        if(node.count("level") > 0)
+        {
+            level = LogXX::message::stringToLevel(node.get<std::string>("level"));
+        }
+
+        for(const auto &child : node)
+        {
+            bool enqueue(false);
+
+            if(child.second.count("name") == 0)
+            {
+                enqueue = true;
+            }
+            else
+            {
+                std::string messageName;
+
+                if(boost::algorithm::iequals(child.first, "module"))
+                {
+                    messageName = msg->getModule();
+                }
+                else if(boost::algorithm::iequals(child.first, "file"))
+                {
+                    messageName = msg->getFile().generic_string();
+                }
+                else if(boost::algorithm::iequals(child.first, "function"))
+                {
+                    messageName = msg->getFunction();
+                }
+                else if(boost::algorithm::iequals(child.first, "class"))
+                {
+                    messageName = msg->getClass();
+                }
+
+                enqueue = boost::algorithm::iequals(messageName, child.second.get<std::string>("name"));
+            }
+
+            if(enqueue)
+            {
+                treeQueue.push(child.second);
+            }
+        }
+
+        treeQueue.pop();
+    }
+
+    return level;
+}
+
+//! First lookup of a call site against a configuration with thousands of rules, walked and compiled
+void benchConfiguration(unsigned modules, unsigned classes, unsigned functions)
+{
+    static const char *levelNames[] = {"critical", "error", "warning", "info", "debug"};
+    boost::property_tree::ptree root;
+    root.put("level", "error");
+
+    for(unsigned m = 0; m < modules; ++m)
+    {
+        boost::property_tree::ptree module;
+        module.put("name", "Module" + std::to_string(m));
+
+        for(unsigned c = 0; c < classes; ++c)
+        {
+            boost::property_tree::ptree klass;
+            klass.put("name", "Class" + std::to_string(c));
+            klass.put("level", levelNames[(m + c) % 5]);
+
+            for(unsigned f = 0; f < functions; ++f)
+            {
+                boost::property_tree::ptree function;
+                function.put("name", "function" + std::to_string(f));
+                function.put("level", levelNames[(m + c + f) % 5]);
+                klass.add_child("function", function);
+            }
+
+            module.add_child("class", klass);
+        }
+
+        root.add_child("module", module);
+    }
+
+    auto configFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.json"));
+    boost::property_tree::write_json(configFile.string(), root);
+    LogXX::configuration config(configFile);
+    boost::filesystem::remove(configFile);
+
+    // Call sites spread over the rules, names in a different case to the configuration
+    std::vector<std::string> names;
+    std::deque<LogXX::callsite> sites;
+    std::vector<std::shared_ptr<LogXX::message>> messages;
+    names.reserve(3 * 1000);
+
+    for(unsigned i = 0; i < 1000; ++i)
+    {
+        names.push_back("MODULE" + std::to_string(i % (modules + 1)));
+        names.push_back("class" + std::to_string(i % (classes + 1)));
+        names.push_back("FUNCTION" + std::to_string(i % (functions + 1)));
+        sites.emplace_back("bench.cpp", names[3 * i + 2].c_str(), "", names[3 * i + 1].c_str(), names[3 * i].c_str(), i);
+        messages.push_back(LogXX::message::create(sites.back(), LogXX::LOG_INFO));
+    }
+
+    std::vector<LogXX::levels> walkedLevels, compiledLevels;
+    walkedLevels.reserve(messages.size());
+    compiledLevels.reserve(messages.size());
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(const auto &msg : messages)
+    {
+        walkedLevels.push_back(legacyLevel(root, msg));
+    }
+
+    auto walked(std::chrono::steady_clock::now() - start);
+    start = std::chrono::steady_clock::now();
+
+    for(const auto &msg : messages)
+    {
+        compiledLevels.push_back(config.getLevel(msg));
+    }
+
+    auto compiled(std::chrono::steady_clock::now() - start);
+    auto mismatches(messages.size() - std::inner_product(walkedLevels.begin(), walkedLevels.end(), compiledLevels.begin(), size_t(0),
+                    std::plus<size_t>(), std::equal_to<LogXX::levels>()));
+
+    std::cout << boost::format("%|| rules: walked %|10.1f|us/call site compiled %|7.2f|us/call site, %|| mismatches\n")
+              % (modules * classes * (functions + 1))
+              % (std::chrono::duration<double, std::micro>(walked).count() / messages.size())
+              % (std::chrono::duration<double, std::micro>(compiled).count() / messages.size())
+              % mismatches;
+}
+
+//! Cached configuration lookups from `threads` threads at once, all hitting the same call sites
+void benchConfigurationScaling(unsigned threads, unsigned rounds)
+{
+    LogXX::configuration config((boost::filesystem::path()));
+    std::deque<LogXX::callsite> sites;
+    std::vector<std::shared_ptr<LogXX::message>> messages;
+
+    for(unsigned i = 0; i < 1000; ++i)
+    {
+        sites.emplace_back("bench.cpp", "function", "", "", "", i, LogXX::LOG_INFO, 0x9E3779B97F4A7C15ull * (i + 1));
+        messages.push_back(LogXX::message::create(sites.back(), LogXX::LOG_INFO));
+        config.getMessageLevel(messages.back());
+    }
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> go(false);
+    std::atomic<unsigned> enabled(0);
+
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]
+        {
+            unsigned count(0);
+
+            while(!go)
+            {
+                std::this_thread::yield();
+            }
+
+            for(unsigned r = 0; r < rounds; ++r)
+            {
+                for(const auto &msg : messages)
+                {
+                    count += config.getMessageLevel(msg) >= LogXX::LOG_INFO;
+                }
+            }
+
+            enabled += count;
+        });
+    }
+
+    auto start(std::chrono::steady_clock::now());
+    go = true;
+
+    for(auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    auto elapsed(std::chrono::steady_clock::now() - start);
+    double lookups(static_cast<double>(threads) * rounds * messages.size());
+
+    std::cout << boost::format("cached lookups, %|2| threads %|8.2f|ns/lookup %|12.0f| lookups/sec\n")
+              % threads
+              % (std::chrono::duration<double, std::nano>(elapsed).count() * threads / lookups)
+              % (lookups / std::chrono::duration<double>(elapsed).count());
+}
+
+//! A default header rendered the way headers were before the per second timestamp cache
+std::string legacyHeader(const std::shared_ptr<LogXX::message> &msg)
+{
+    auto logTime(msg->getDate());
+    auto day(date::floor<date::days>(logTime));
+    auto file(msg->getFile());
+
+    boost::format header(LogXX::message::defaultHeaderFormat);
+    header.exceptions(boost::io::all_error_bits ^ (boost::io::too_few_args_bit | boost::io::too_many_args_bit));
+
+    header % date::year_month_day{day}
+           % date::make_time(logTime - day)
+           % LogXX::message::levelToString(msg->getLevel())
+           % msg->getThreadID()
+           % file.filename()
+           % file
+           % (*msg->getExtendedFunction() ? msg->getExtendedFunction() : msg->getFunction())
+           % msg->getFunction()
+           % msg->getExtendedFunction();
+
+    return header.str();
+}
+
+//! Cost of a default header, rendered the way headers used to be, with the per second timestamp cache and with a
+//! compiled header layout
+void benchTimestamps(unsigned count)
+{
+    static LogXX::callsite site(__FILE__, __func__, FUNC_NAME, "", "", __LINE__, LogXX::LOG_INFO, LINECRC);
+    auto msg(LogXX::message::create(site, LogXX::LOG_INFO));
+    auto logTime(std::chrono::system_clock::now());
+    unsigned differences(0);
+
+    std::vector<std::string> headers;
+    headers.reserve(count);
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        msg->set_date(logTime + std::chrono::microseconds(i));
+        headers.push_back(legacyHeader(msg));
+    }
+
+    auto rendered(std::chrono::steady_clock::now() - start);
+    start = std::chrono::steady_clock::now();
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        msg->set_date(logTime + std::chrono::microseconds(i));
+        differences += msg->getMessageHeaderConst(LogXX::message::defaultHeaderFormat).str() != headers[i];
+    }
+
+    auto cached(std::chrono::steady_clock::now() - start);
+    LogXX::headerLayout layout;
+    std::string header;
+    start = std::chrono::steady_clock::now();
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        msg->set_date(logTime + std::chrono::microseconds(i));
+        header.clear();
+        layout.render(*msg, header);
+        differences += header != headers[i];
+    }
+
+    auto compiled(std::chrono::steady_clock::now() - start);
+
+    std::cout << boost::format("default header, date rendered %|7.1f|ns/header cached %|7.1f|ns/header compiled %|7.1f|ns/header, %|| differ\n")
+              % (std::chrono::duration<double, std::nano>(rendered).count() / count)
+              % (std::chrono::duration<double, std::nano>(cached).count() / count)
+              % (std::chrono::duration<double, std::nano>(compiled).count() / count)
+              % differences;
+}
+
+//! Cost of stamping a message with the system clock and with the cycle counter, and how far converted stamps drift
+void benchClock(unsigned count)
+{
+    static LogXX::callsite site(__FILE__, __func__, FUNC_NAME, "", "", __LINE__, LogXX::LOG_INFO, LINECRC);
+
+    if(!LogXX::tscClock::available())
+    {
+        std::cout << "no invariant cycle counter, messages use the system clock\n";
+        return;
+    }
+
+    auto create([](unsigned count)
+    {
+        auto start(std::chrono::steady_clock::now());
+
+        for(unsigned i = 0; i < count; ++i)
+        {
+            LogXX::message::create(site, LogXX::LOG_INFO);
+        }
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    });
+
+    LogXX::tscClock::enable(false);
+    double systemClock(create(count));
+    LogXX::tscClock::enable(true);
+    double cycleCounter(create(count));
+    LogXX::tscClock::enable(false);
+
+    std::cout << boost::format("message create, system clock %|6.1f|ns cycle counter %|6.1f|ns\n") % systemClock % cycleCounter;
+
+    // Convert the way the log thread does and compare against the system clock read right after the counter
+    LogXX::tscClock clock;
+    std::chrono::system_clock::duration worst(0);
+    auto end(std::chrono::steady_clock::now() + std::chrono::seconds(3));
+
+    while(std::chrono::steady_clock::now() < end)
+    {
+        clock.calibrate();
+        uint64_t ticks(LogXX::tscClock::ticks());
+        auto now(std::chrono::system_clock::now());
+        auto error(clock.toSystem(ticks) - now);
+
+        worst = std::max(worst, error < error.zero() ? -error : error);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::cout << boost::format("converted stamps over 3s, worst error %|6.2f|us\n")
+              % std::chrono::duration<double, std::micro>(worst).count();
+}
+
+//! Cost of formatting a message body from a runtime parsed format string and from a compile time parsed one
+void benchFormat(unsigned count)
+{
+    static LogXX::callsite site(__FILE__, __func__, FUNC_NAME, "", "", __LINE__, LogXX::LOG_INFO, LINECRC);
+    static constexpr LogXX::formatTable<sizeof("request %1% took %2%ms from %3% (%4%)")> table("request %1% took %2%ms from %3% (%4%)");
+    auto msg(LogXX::message::create(site, LogXX::LOG_INFO));
+    std::string peer("10.0.0.1:443");
+    unsigned differences(0);
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        msg->format(table.text(), i, i * 0.25, peer, LogXX::LOG_WARNING);
+    }
+
+    auto runtime(std::chrono::steady_clock::now() - start);
+    start = std::chrono::steady_clock::now();
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        msg->formatStatic(table, table.text(), i, i * 0.25, peer, LogXX::LOG_WARNING);
+    }
+
+    auto compiled(std::chrono::steady_clock::now() - start);
+
+    for(unsigned i = 0; i < count; i += 997)
+    {
+        msg->format(table.text(), i, i * 0.25, peer, LogXX::LOG_WARNING);
+        std::string body(msg->getMessage());
+        msg->formatStatic(table, table.text(), i, i * 0.25, peer, LogXX::LOG_WARNING);
+        differences += msg->getMessage() != body;
+    }
+
+    std::cout << boost::format("4 argument body, boost::format %|7.1f|ns/message compiled %|7.1f|ns/message, %|| differ\n")
+              % (std::chrono::duration<double, std::nano>(runtime).count() / count)
+              % (std::chrono::duration<double, std::nano>(compiled).count() / count)
+              % differences;
+}
+
+//! Consumer side cost of a log back end, the same message is written `count` times
+void benchTarget(const std::string &name, std::shared_ptr<LogXX::logTarget> target, unsigned count)
+{
+    static LogXX::callsite site(__FILE__, __func__, FUNC_NAME, "", "", __LINE__, LogXX::LOG_INFO, LINECRC);
+    auto msg(LogXX::message::create(site, LogXX::LOG_INFO));
+    msg->format("target benchmark %1% %2% %3%", 42, 3.14, "text");
+
+    auto start(std::chrono::steady_clock::now());
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        target->LogMessage(msg);
+    }
+
+    target.reset();
+    auto elapsed(std::chrono::steady_clock::now() - start);
+
+    std::cout << boost::format("%|-24| %|12.0f| msgs/sec\n") % name % (count / std::chrono::duration<double>(elapsed).count());
+}
+
+//! usage: LogBench [section...], runs every section when none are named
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> sections(argv + 1, argv + argc);
+
+    auto run([&sections](const std::string &section, const std::string &title)
+    {
+        if(!sections.empty() && std::find(sections.begin(), sections.end(), section) == sections.end())
+        {
+            return false;
+        }
+
+        std::cout << title << std::endl;
+        return true;
+    });
+
+    if(run("latency", "Producer latency"))
+    {
+        for(unsigned threads : {1, 8, 32, 64})
+        {
+            benchProducerLatency(threads, 400000 / threads);
+        }
+    }
+
+    if(run("filter", "Call site filtering"))
+    {
+        benchDisabledCallsite(10000000);
+    }
+
+    if(run("ratelimit", "Rate limited call sites"))
+    {
+        for(unsigned threads : {1, 4, 16})
+        {
+            benchRateLimited(threads, 4000000 / threads);
+        }
+    }
+
+    if(run("allocations", "Message allocation"))
+    {
+        benchAllocations(100000);
+    }
+
+    if(run("config", "Configuration lookup"))
+    {
+        benchConfiguration(10, 10, 5);
+        benchConfiguration(50, 20, 5);
+
+        for(unsigned threads : {1, 2, 4, 8})
+        {
+            benchConfigurationScaling(threads, 20000 / threads);
+        }
+    }
+
+    if(run("stream", "Streaming macros"))
+    {
+        benchStreaming(100000);
+    }
+
+    if(run("slow", "Slow back ends"))
+    {
+        benchSlowTarget(false, 20000);
+        benchSlowTarget(true, 20000);
+    }
+
+    if(run("overflow", "Overflow policies"))
+    {
+        benchOverflow(LogXX::OVERFLOW_BLOCK, "block", 20000);
+        benchOverflow(LogXX::OVERFLOW_DROP_NEWEST, "drop newest", 20000);
+        benchOverflow(LogXX::OVERFLOW_DROP_OLDEST, "drop oldest", 20000);
+        benchOverflow(LogXX::OVERFLOW_DROP_BELOW_LEVEL, "drop below warning", 20000);
+        benchOverflow(LogXX::OVERFLOW_DROP_OLDEST, "drop oldest thread", 20000, true);
+    }
+
+    if(run("headers", "Header formatting"))
+    {
+        benchTimestamps(1000000);
+    }
+
+    if(run("format", "Message formatting"))
+    {
+        benchFormat(1000000);
+    }
+
+    if(run("clock", "Time stamps"))
+    {
+        benchClock(10000000);
+    }
+
+#ifdef __linux__
+    if(run("async", "Asynchronous file writes"))
+    {
+        // tmpfs shows the cost of the write path itself, a real disk adds the device
+        std::vector<std::pair<std::string, boost::filesystem::path>> places{{"disk", boost::filesystem::temp_directory_path()}};
+
+        if(boost::filesystem::is_directory("/dev/shm"))
+        {
+            places.insert(places.begin(), {"tmpfs", "/dev/shm"});
+        }
+
+        for(const auto &place : places)
+        {
+            auto file(place.second / boost::filesystem::unique_path("logbench-%%%%%%.log"));
+
+            LogXX::logAsyncFile::asyncPolicy threads;
+            threads.uring = false;
+
+            LogXX::logAsyncFile::asyncPolicy direct;
+            direct.direct = true;
+
+            benchTarget("ofstream " + place.first, std::make_shared<ofstreamTarget>(file), 1000000);
+            benchTarget("logFile " + place.first, std::make_shared<LogXX::logFile>(file), 10000000);
+
+            auto uring(std::make_shared<LogXX::logAsyncFile>(file));
+            auto name(std::string(uring->usingUring() ? "io_uring " : "no io_uring ") + place.first);
+            benchTarget(name, std::move(uring), 10000000);
+            benchTarget("pwrite threads " + place.first, std::make_shared<LogXX::logAsyncFile>(file, threads), 10000000);
+
+            auto unbuffered(std::make_shared<LogXX::logAsyncFile>(file, direct));
+            name = std::string(unbuffered->usingDirect() ? "O_DIRECT " : "no O_DIRECT ") + place.first;
+            benchTarget(name, std::move(unbuffered), 10000000);
+
+            boost::filesystem::remove(file);
+        }
+    }
+#endif
+
+    if(run("targets", "Log back ends"))
+    {
+        auto textFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.log"));
+        auto binaryFile(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("logbench-%%%%%%.bin"));
+
+        // A zero sized buffer writes every message as it arrives, the way logFile used to
+        LogXX::logFile::flushPolicy unbuffered;
+        unbuffered.bufferSize = 0;
+
+        benchTarget("logFile unbuffered", std::make_shared<LogXX::logFile>(textFile, unbuffered), 10000000);
+        benchTarget("logFile", std::make_shared<LogXX::logFile>(textFile), 10000000);
+
+        // Rotating and compressing in the background shouldn't slow the writer down
+        LogXX::logFile::rotationPolicy rotation;
+        rotation.maxSize = 64 * 1024 * 1024;
+        rotation.keep = 2;
+        rotation.compress = true;
+
+        benchTarget("logFile rotating", std::make_shared<LogXX::logFile>(textFile, LogXX::logFile::flushPolicy(), rotation), 10000000);
+        benchTarget("logBinary", std::make_shared<LogXX::logBinary>(binaryFile), 1000000);
+#ifndef _WIN32
+        benchTarget("logMappedFile", std::make_shared<LogXX::logMappedFile>(textFile), 10000000);
+#endif
+
+        for(boost::filesystem::directory_iterator entry(textFile.parent_path()), end; entry != end; ++entry)
+        {
+            if(entry->path().filename().string().compare(0, textFile.filename().string().size(), textFile.filename().string()) == 0)
+            {
+                boost::filesystem::remove(entry->path());
+            }
+        }
+
+        boost::filesystem::remove(binaryFile);
+    }
+}
@@ -0,0 +1,514 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <regex>
+#include <tuple>
+#include <algorithm>
+#include <cstdlib>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include "log_message.h"
+#include "log_manager.h"
+
+namespace fs = boost::filesystem;
+
+//! Closed files of `log`, oldest first
+//! \param[out] badNames files starting with the log's name that aren't "<log>.<YYYYMMDD-HHMMSS>[.N][.gz]"
+std::vector<fs::path> segments(const fs::path &log, unsigned &badNames)
+{
+    static const std::regex name(R"((\d{8}-\d{6})(?:\.(\d+))?(\.gz)?)");
+    std::string prefix(log.filename().string() + ".");
+    std::vector<std::tuple<std::string, unsigned, fs::path>> found;
+
+    badNames = 0;
+
+    for(fs::directory_iterator entry(log.parent_path()), end; entry != end; ++entry)
+    {
+        auto file(entry->path().filename().string());
+        std::smatch match;
+
+        if(file.compare(0, prefix.size(), prefix) != 0)
+        {
+            continue;
+        }
+
+        auto rest(file.substr(prefix.size()));
+
+        if(!std::regex_match(rest, match, name))
+        {
+            ++badNames;
+            continue;
+        }
+
+        found.emplace_back(match[1].str(), match[2].matched ? static_cast<unsigned>(std::stoul(match[2].str())) : 0u, entry->path());
+    }
+
+    std::sort(found.begin(), found.end());
+
+    std::vector<fs::path> paths;
+
+    for(const auto &segment : found)
+    {
+        paths.push_back(std::get<2>(segment));
+    }
+
+    return paths;
+}
+
+//! Contents of a log file, gzip files are decompressed
+//! \return false if the file can't be read or doesn't decompress
+bool readLog(const fs::path &file, std::string &text)
+{
+    text.clear();
+
+    try
+    {
+        fs::ifstream in(file, std::ios::binary);
+        boost::iostreams::filtering_istream input;
+
+        if(!in)
+        {
+            return false;
+        }
+
+        if(file.extension() == ".gz")
+        {
+            input.push(boost::iostreams::gzip_decompressor());
+        }
+
+        input.push(in);
+
+        std::vector<char> block(64 * 1024);
+
+        while(input.read(block.data(), block.size()) || input.gcount() > 0)
+        {
+            text.append(block.data(), input.gcount());
+        }
+
+        return !input.bad();
+    }
+    catch(const std::exception &)
+    {
+        return false;
+    }
+}
+
+//! Numbers of the "filetest <n>" messages in `text`, in the order they were written
+void numbers(const std::string &text, std::vector<unsigned> &found)
+{
+    // Not sscanf(), which takes the length of the whole rest of the text every time
+    for(auto at(text.find("filetest ")); at != std::string::npos; at = text.find("filetest ", at + 1))
+    {
+        const char *digits(text.c_str() + at + 9);
+        char *end;
+        auto number(std::strtoul(digits, &end, 10));
+
+        if(end != digits)
+        {
+            found.push_back(static_cast<unsigned>(number));
+        }
+    }
+}
+
+//! True if `found` is `first`, `first + 1` and so on up to `last`
+bool consecutive(const std::vector<unsigned> &found, unsigned first, unsigned last)
+{
+    if(found.size() != last - first + 1)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < found.size(); ++i)
+    {
+        if(found[i] != first + i)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! Check `done` every 10ms until it is true or `timeout` has gone by
+template <typename Done>
+bool waitFor(Done done, std::chrono::milliseconds timeout = std::chrono::seconds(10))
+{
+    auto until(std::chrono::steady_clock::now() + timeout);
+
+    while(!done())
+    {
+        if(std::chrono::steady_clock::now() > until)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+//! Log "filetest <first>" to "filetest <last>", every `errorEvery`th one and the last one as errors when not 0
+void logLines(unsigned first, unsigned last, unsigned errorEvery = 0)
+{
+    for(unsigned i = first; i <= last; ++i)
+    {
+        if(errorEvery != 0 && (i % errorEvery == 0 || i == last))
+        {
+            _err("filetest %1% padding the line out to a realistic length", i);
+        }
+        else
+        {
+            _info("filetest %1% padding the line out to a realistic length", i);
+        }
+    }
+}
+
+bool Report(const std::string &name, bool passed, const std::string &detail)
+{
+    std::cout << boost::format("%|-28| %|-60| %||\n") % name % detail % (passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+//! Rotate on size with compression, every closed file has to be a well named gzip file no bigger than the limit, and
+//! all of them together with the open file have to hold every message exactly once, in order
+bool rotateOnSize(const fs::path &directory)
+{
+    fs::path log(directory / "size.log");
+    LogXX::logFile::flushPolicy flush;
+    LogXX::logFile::rotationPolicy rotation;
+    flush.bufferSize = 4096;
+    rotation.maxSize = 16 * 1024;
+    rotation.compress = true;
+
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto target(std::make_shared<LogXX::logFile>(log, flush, rotation));
+    logManager->addTarget(target);
+    logManager->Run();
+    logLines(0, 4999);
+    logManager->Shutdown();
+
+    // Compression is abandoned when the file is closed, let it finish first
+    unsigned badNames(0);
+    bool compressed(waitFor([&]
+    {
+        auto closed(segments(log, badNames));
+        return std::all_of(closed.begin(), closed.end(), [](const fs::path &segment) { return segment.extension() == ".gz"; });
+    }));
+
+    logManager.reset();
+    target.reset();
+
+    auto closed(segments(log, badNames));
+    std::vector<unsigned> found;
+    std::string text;
+    unsigned unreadable(0), oversized(0);
+
+    for(const auto &segment : closed)
+    {
+        if(!readLog(segment, text))
+        {
+            ++unreadable;
+        }
+
+        oversized += text.size() > rotation.maxSize;
+        numbers(text, found);
+    }
+
+    readLog(log, text);
+    numbers(text, found);
+
+    bool complete(consecutive(found, 0, 4999));
+
+    return Report("rotate on size", compressed && badNames == 0 && closed.size() > 2 && unreadable == 0 && oversized == 0 && complete,
+                  (boost::format("%|| files, %|| badly named, %|| unreadable, %|| oversized, %|| messages %||")
+                   % closed.size() % badNames % unreadable % oversized % found.size() % (complete ? "in order" : "out of order")).str());
+}
+
+//! Files left by an earlier run: a closed file is compressed, a half written gzip file deleted and the open file closed
+bool resumeCompression(const fs::path &directory)
+{
+    fs::path log(directory / "resume.log");
+    fs::path leftover(directory / "resume.log.20200101-000000");
+    fs::path partial(directory / "resume.log.20200101-000001.gz.part");
+
+    fs::ofstream(leftover) << "filetest 0\nfiletest 1\n";
+    fs::ofstream(partial) << "not really gzip";
+    fs::ofstream(log) << "filetest 2\n";
+
+    LogXX::logFile::rotationPolicy rotation;
+    rotation.compress = true;
+
+    auto target(std::make_shared<LogXX::logFile>(log, LogXX::logFile::flushPolicy(), rotation));
+    unsigned badNames(0);
+    bool finished(waitFor([&]
+    {
+        auto closed(segments(log, badNames));
+        return !fs::exists(partial) && closed.size() == 2 &&
+               std::all_of(closed.begin(), closed.end(), [](const fs::path &segment) { return segment.extension() == ".gz"; });
+    }));
+
+    target.reset();
+
+    std::vector<unsigned> found;
+    std::string text;
+    bool readable(true);
+
+    for(const auto &segment : segments(log, badNames))
+    {
+        readable &= readLog(segment, text);
+        numbers(text, found);
+    }
+
+    return Report("resume compression", finished && readable && badNames == 0 && consecutive(found, 0, 2),
+                  (boost::format("%|| files compressed, %|| messages kept") % (finished ? "all" : "not all") % found.size()).str());
+}
+
+//! Only the newest `keep` closed files are kept, and they follow on from each other and the open file
+bool keepNewest(const fs::path &directory)
+{
+    fs::path log(directory / "keep.log");
+    LogXX::logFile::flushPolicy flush;
+    LogXX::logFile::rotationPolicy rotation;
+    flush.bufferSize = 4096;
+    rotation.maxSize = 16 * 1024;
+    rotation.keep = 3;
+
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto target(std::make_shared<LogXX::logFile>(log, flush, rotation));
+    logManager->addTarget(target);
+    logManager->Run();
+    logLines(0, 4999);
+    logManager->Shutdown();
+
+    unsigned badNames(0);
+    bool pruned(waitFor([&] { return segments(log, badNames).size() <= rotation.keep; }));
+
+    logManager.reset();
+    target.reset();
+
+    auto closed(segments(log, badNames));
+    std::vector<unsigned> found;
+    std::string text;
+
+    for(const auto &segment : closed)
+    {
+        readLog(segment, text);
+        numbers(text, found);
+    }
+
+    readLog(log, text);
+    numbers(text, found);
+
+    bool newest(!found.empty() && consecutive(found, found.front(), 4999));
+
+    return Report("keep newest", pruned && badNames == 0 && closed.size() == rotation.keep && newest,
+                  (boost::format("%|| files kept, newest messages %||") % closed.size() % (newest ? "complete" : "missing")).str());
+}
+
+//! A rotating file back end set up from the configuration file
+bool configuredBackend(const fs::path &directory)
+{
+    fs::path log(directory / "configured.log");
+    fs::path config(directory / "configured.json");
+
+    fs::ofstream(config) << R"({ "level": "debug", "backend": { "type": "file", "file": ")" << log.generic_string()
+                         << R"(", "rotate_size": "16K", "keep": "2" } })";
+
+    auto logManager(std::make_shared<LogXX::manager>(config));
+    logManager->addConfiguredTargets();
+    logManager->Run();
+    logLines(0, 4999);
+    logManager->Shutdown();
+
+    unsigned badNames(0);
+    bool pruned(waitFor([&] { return segments(log, badNames).size() <= 2; }));
+
+    logManager.reset();
+
+    auto closed(segments(log, badNames));
+    std::vector<unsigned> found;
+    std::string text;
+
+    for(const auto &segment : closed)
+    {
+        readLog(segment, text);
+        numbers(text, found);
+    }
+
+    readLog(log, text);
+    numbers(text, found);
+
+    bool newest(!found.empty() && consecutive(found, found.front(), 4999));
+
+    return Report("configured back end", pruned && badNames == 0 && closed.size() == 2 && newest,
+                  (boost::format("%|| files kept, newest messages %||") % closed.size() % (newest ? "complete" : "missing")).str());
+}
+
+#ifdef __linux__
+//! Write through logAsyncFile with small buffers and frequent error messages, so the last block is written padded over
+//! and over. Once things settle the file has to end with the last message, no padding, and hold every message in order.
+bool asyncContents(const fs::path &directory, bool direct, bool uring)
+{
+    fs::path log(directory / (boost::format("async-%||-%||.log") % (direct ? "direct" : "buffered") % (uring ? "uring" : "threads")).str());
+    LogXX::logAsyncFile::asyncPolicy policy;
+    policy.bufferSize = 8192;
+    policy.interval = std::chrono::milliseconds(20);
+    policy.direct = direct;
+    policy.uring = uring;
+
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto target(std::make_shared<LogXX::logAsyncFile>(log, policy));
+    logManager->addTarget(target);
+    logManager->Run();
+
+    std::string text;
+    std::vector<unsigned> found;
+    bool settled(true);
+
+    for(unsigned round = 0; round < 20; ++round)
+    {
+        logLines(round * 1000, round * 1000 + 999, 7);
+
+        // Time for the log thread to catch up and collect the writes, watching the end of the file is enough for that
+        auto last((boost::format("filetest %|| padding the line out to a realistic length\n") % (round * 1000 + 999)).str());
+
+        waitFor([&]
+        {
+            fs::ifstream in(log, std::ios::binary);
+            std::string end(last.size(), ' ');
+
+            in.seekg(-static_cast<std::streamoff>(last.size()), std::ios::end);
+            return in.read(&end[0], end.size()) && end == last;
+        }, std::chrono::seconds(2));
+
+        found.clear();
+        readLog(log, text);
+        numbers(text, found);
+        settled &= consecutive(found, 0, round * 1000 + 999) && text.find('\0') == std::string::npos;
+    }
+
+    logManager->Shutdown();
+    logManager.reset();
+
+    auto errors(target->getErrors());
+    auto name((boost::format("async %|| %||") % (target->usingDirect() ? "direct" : "buffered") % (target->usingUring() ? "io_uring" : "threads")).str());
+    target.reset();
+
+    found.clear();
+    readLog(log, text);
+    numbers(text, found);
+
+    bool complete(consecutive(found, 0, 19999));
+    bool padded(text.find('\0') != std::string::npos);
+
+    return Report(name, settled && complete && !padded && errors == 0 && fs::file_size(log) == text.size(),
+                  (boost::format("%|| messages %||, %||, %|| errors%||") % found.size() % (complete ? "in order" : "out of order")
+                   % (padded ? "padding left in the file" : "no padding") % errors % (settled ? "" : ", didn't settle")).str());
+}
+#endif
+
+#ifndef _WIN32
+//! Mapped file while it is being written, the end of the file must stay within a step of the newest message
+bool mappedContents(const fs::path &directory)
+{
+    fs::path log(directory / "mapped.log");
+    const size_t chunk(4 * 1024 * 1024), step(1024 * 1024);
+
+    auto logManager(std::make_shared<LogXX::manager>());
+    auto target(std::make_shared<LogXX::logMappedFile>(log, chunk, std::chrono::milliseconds(20)));
+    logManager->addTarget(target);
+    logManager->Run();
+
+    std::string text;
+    std::vector<unsigned> found;
+    bool settled(true);
+    uintmax_t furthest(0);
+
+    for(unsigned round = 0; round < 20; ++round)
+    {
+        logLines(round * 1000, round * 1000 + 999);
+
+        auto last((boost::format("filetest %|| padding the line out to a realistic length\n") % (round * 1000 + 999)).str());
+
+        // The messages are in the mapping as soon as they are logged, what follows them up to the end of the file is zeros.
+        // A read that races the log thread can miss messages before the last one, so read again once it is there.
+        settled &= waitFor([&]
+        {
+            return readLog(log, text) && text.find(last) != std::string::npos;
+        }, std::chrono::seconds(2));
+        readLog(log, text);
+
+        auto end(std::min(text.find('\0'), text.size()));
+        furthest = std::max<uintmax_t>(furthest, text.size() - end);
+        settled &= text.find_first_not_of('\0', end) == std::string::npos;
+
+        found.clear();
+        numbers(text.substr(0, end), found);
+        settled &= consecutive(found, 0, round * 1000 + 999);
+    }
+
+    logManager->Shutdown();
+    logManager.reset();
+    target.reset();
+
+    found.clear();
+    readLog(log, text);
+    numbers(text, found);
+
+    bool complete(consecutive(found, 0, 19999));
+    bool trimmed(text.find('\0') == std::string::npos && fs::file_size(log) == text.size());
+
+    return Report("mapped", settled && complete && trimmed && furthest <= step,
+                  (boost::format("%|| messages %||, at most %|| bytes past the newest while open, %||%||") % found.size()
+                   % (complete ? "in order" : "out of order") % furthest % (trimmed ? "trimmed" : "not trimmed")
+                   % (settled ? "" : ", didn't settle")).str());
+}
+#endif
+
+//! usage: LogFileTest, checks the file back ends in a temporary directory, which is kept if anything fails
+int main()
+{
+    fs::path directory(fs::temp_directory_path() / fs::unique_path("logfiletest-%%%%%%"));
+    fs::create_directories(directory);
+
+    bool passed(true);
+
+    passed &= rotateOnSize(directory);
+    passed &= resumeCompression(directory);
+    passed &= keepNewest(directory);
+    passed &= configuredBackend(directory);
+
+#ifdef __linux__
+    for(bool direct : {false, true})
+    {
+        for(bool uring : {true, false})
+        {
+            passed &= asyncContents(directory, direct, uring);
+        }
+    }
+#endif
+
+#ifndef _WIN32
+    passed &= mappedContents(directory);
+#endif
+
+    if(passed)
+    {
+        fs::remove_all(directory);
+    }
+    else
+    {
+        std::cout << "files left in " << directory << "\n";
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
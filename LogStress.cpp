@@ -0,0 +1,207 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <boost/format.hpp>
+
+#include "log_message.h"
+#include "log_manager.h"
+
+//! What a run expects of the order messages arrive in
+enum class ordering
+{
+    none,       //!< no reorder window, order isn't checked
+    strict,     //!< every message in order
+    counted     //!< every message out of order counted by the manager, see manager::getOrderViolations()
+};
+
+//! Log back end that checks every message arrives exactly once and in time, and in order when asked to
+//! \note Messages are logged as "stress <producer> <sequence>"
+class checkTarget : public LogXX::logTarget
+{
+    public:
+        checkTarget(unsigned producers, unsigned count, std::chrono::system_clock::duration bound, ordering order)
+            : m_seen(producers, std::vector<uint8_t>(count, 0))
+            , m_next(producers, 0)
+            , m_bound(bound)
+            , m_order(order)
+            , m_late(0)
+            , m_duplicates(0)
+            , m_unknown(0)
+            , m_unordered(0)
+            , m_worst(0)
+        {
+        }
+
+        void LogMessage(std::shared_ptr<LogXX::message> msg) override
+        {
+            auto latency(std::chrono::system_clock::now() - msg->getDate());
+            unsigned producer, sequence;
+
+            if(std::sscanf(msg->getMessageBody().str().c_str(), "stress %u %u", &producer, &sequence) != 2 ||
+               producer >= m_seen.size() || sequence >= m_seen[producer].size())
+            {
+                ++m_unknown;
+                return;
+            }
+
+            if(m_seen[producer][sequence]++)
+            {
+                ++m_duplicates;
+            }
+
+            // Time stamps, ties broken by sequence as the manager does, never go backwards, and each producer's
+            // messages come in the order it logged them
+            auto key(std::make_pair(msg->getDate(), msg->getSequence()));
+
+            if(key < m_last || sequence < m_next[producer])
+            {
+                ++m_unordered;
+            }
+
+            m_last = std::max(m_last, key);
+            m_next[producer] = std::max(m_next[producer], sequence + 1);
+
+            if(latency > m_bound)
+            {
+                ++m_late;
+            }
+
+            m_worst = std::max(m_worst, latency);
+        }
+
+        //! Print the results of a run
+        //! \param[in] violations messages the manager counted as delivered outside its reorder window
+        //! \return true if nothing was lost, repeated or late, and the order was what the run expects
+        bool Report(const std::string &name, uint64_t violations = 0) const
+        {
+            uint64_t lost(0);
+
+            for(const auto &producer : m_seen)
+            {
+                for(auto seen : producer)
+                {
+                    lost += seen == 0;
+                }
+            }
+
+            bool ordered(m_order == ordering::none || m_unordered == (m_order == ordering::strict ? 0 : violations));
+            bool passed(lost == 0 && m_duplicates == 0 && m_unknown == 0 && m_late == 0 && ordered);
+
+            std::cout << boost::format("%|-28| lost %|6| duplicated %|6| late %|6| unordered %|6| (%|| outside window) worst %|8.2f|ms %||\n")
+                      % name
+                      % lost
+                      % m_duplicates
+                      % m_late
+                      % m_unordered
+                      % violations
+                      % std::chrono::duration<double, std::milli>(m_worst).count()
+                      % (passed ? "PASS" : "FAIL");
+
+            return passed;
+        }
+
+    private:
+        std::vector<std::vector<uint8_t>>   m_seen;
+        std::vector<unsigned>               m_next;         //!< next sequence expected from each producer
+        std::chrono::system_clock::duration m_bound;
+        ordering                            m_order;
+        uint64_t                            m_late;
+        uint64_t                            m_duplicates;
+        uint64_t                            m_unknown;
+        uint64_t                            m_unordered;
+        std::pair<std::chrono::system_clock::time_point, uint64_t> m_last;  //!< newest time stamp and sequence seen
+        std::chrono::system_clock::duration m_worst;
+};
+
+//! Log `count` messages from each of `producers` threads, pausing for `gap` between messages
+//! \note A gap lets the log thread go back to sleep between messages, which is where lost wake ups show up. Without a
+//!       gap producers outrun the log thread and wait for room in the queue, so latency is only checked with one.
+//!       With a reorder `window` the output has to be in time stamp order as well, as `order` says.
+bool stress(const std::string &name, unsigned producers, unsigned count, std::chrono::microseconds gap, LogXX::levels level,
+            std::chrono::microseconds maxLatency, std::chrono::milliseconds slack,
+            std::chrono::microseconds window = std::chrono::microseconds(0), size_t queueCapacity = 8192,
+            ordering order = ordering::strict)
+{
+    auto bound(gap.count() != 0 ? std::chrono::system_clock::duration(maxLatency + slack + window) : std::chrono::system_clock::duration::max());
+    auto logManager(std::make_shared<LogXX::manager>(boost::filesystem::path(), queueCapacity));
+    auto target(std::make_shared<checkTarget>(producers, count, bound, window.count() != 0 ? order : ordering::none));
+    logManager->setMaxLatency(maxLatency);
+    logManager->setReorderWindow(window);
+    logManager->addTarget(target);
+    logManager->Run();
+
+    std::vector<std::thread> threads;
+
+    for(unsigned p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([p, count, gap, level]
+        {
+            for(unsigned i = 0; i < count; ++i)
+            {
+                if(level == LogXX::LOG_ERR)
+                {
+                    _err("stress %1% %2%", p, i)
+                }
+                else
+                {
+                    _trace("stress %1% %2%", p, i)
+                }
+
+                if(gap.count() != 0)
+                {
+                    std::this_thread::sleep_for(gap);
+                }
+            }
+        });
+    }
+
+    for(auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // Give the last messages the full bound to arrive before shutting down delivers them anyway
+    std::this_thread::sleep_for(maxLatency + slack + window);
+    logManager->Shutdown();
+
+    return target->Report(name, logManager->getOrderViolations());
+}
+
+//! usage: LogStress [producers] [messages per producer] [max latency ms] [scheduling slack ms] [reorder window ms]
+int main(int argc, char *argv[])
+{
+    unsigned producers(argc > 1 ? std::atoi(argv[1]) : 8);
+    unsigned count(argc > 2 ? std::atoi(argv[2]) : 100000);
+    std::chrono::microseconds maxLatency(std::chrono::milliseconds(argc > 3 ? std::atoi(argv[3]) : 5));
+    std::chrono::milliseconds slack(argc > 4 ? std::atoi(argv[4]) : 50);
+    std::chrono::microseconds window(std::chrono::milliseconds(argc > 5 ? std::atoi(argv[5]) : 20));
+
+    bool passed(true);
+
+    passed &= stress("burst", producers, count, std::chrono::microseconds(0), LogXX::LOG_DEBUG, maxLatency, slack);
+    passed &= stress("trickle", producers, 200, std::chrono::microseconds(2000), LogXX::LOG_DEBUG, maxLatency, slack);
+    passed &= stress("trickle, errors", producers, 200, std::chrono::microseconds(2000), LogXX::LOG_ERR, maxLatency, slack);
+    passed &= stress("sparse", 1, 50, std::chrono::microseconds(150000), LogXX::LOG_DEBUG, maxLatency, slack);
+
+    // Messages are only ordered if they reach the log thread within the window. In a burst the log thread falls behind
+    // by up to as long as the burst lasts, and producers waiting for room hold on to messages they have stamped. So the
+    // burst is smaller, it gets a queue that holds all of it, and its window is longer than it lasts.
+    unsigned orderedCount(std::max(count / 10, 1u));
+    passed &= stress("ordered burst", producers, orderedCount, std::chrono::microseconds(0), LogXX::LOG_DEBUG, maxLatency, slack,
+                     std::max<std::chrono::microseconds>(window, std::chrono::seconds(1)), producers * orderedCount);
+    passed &= stress("ordered trickle", producers, 200, std::chrono::microseconds(2000), LogXX::LOG_DEBUG, maxLatency, slack, window);
+
+    // With the default queue the same burst fills it, and ordering isn't guaranteed, but every message delivered out of
+    // order has to be one the manager counted
+    passed &= stress("ordered back pressure", producers, orderedCount, std::chrono::microseconds(0), LogXX::LOG_DEBUG, maxLatency,
+                     slack, window, 8192, ordering::counted);
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -86,6 +86,16 @@ int main(void)
     _warn("warn: %d %s", std::rand(), "foo bar baz");
     _err("err: %d %s", std::rand(), "foo bar baz");
     _sev("sev: %d %s", std::rand(), "foo bar baz");
+    _info("percent: %1%%% of %2%", 100, "50% %1%");
+
+    _trace_s << "stream trace: " << std::rand() << " 100% " << std::hex << 255;
+    _info_s << "stream info: " << std::rand() << ' ' << FOO_BAR;
+    _warn_s << "stream warn: " << 3.14159;
+    _err_s << "stream err: " << std::string("foo bar baz");
+    _sev_s << "stream sev";
+
+    auto level(std::rand() % 2 ? LogXX::LOG_WARNING : LogXX::LOG_ERR);
+    _log_s(level) << "stream at a run time level"; _info_s << "stream on the same line";
 
 
     logManager->Shutdown();
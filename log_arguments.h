@@ -0,0 +1,79 @@
+/**
+ * @file   log_arguments.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Captured log message arguments.
+ * @details Type erased storage used to carry log message arguments to the log thread so they can be formatted there
+ */
+
+#pragma once
+#ifndef _LOG_ARGUMENTS_H_
+#define _LOG_ARGUMENTS_H_
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <boost/format.hpp>
+
+#include "log_format.h"
+
+namespace LogXX
+{
+    //! Interface to a set of captured arguments
+    class argumentPack
+    {
+        public:
+            virtual ~argumentPack() = default;
+
+            //! Feed the captured arguments to a format object through the `print()` extension points
+            virtual boost::format &apply(boost::format &fmt) const = 0;
+    };
+
+    //! Type used to hold an argument until the log thread gets to it
+    //! \note C strings are copied, the caller's buffer may be long gone by the time the message is formatted
+    template <typename T>
+    struct captured
+    {
+        using type = std::decay_t<T>;
+    };
+
+    template <>
+    struct captured<const char *>
+    {
+        using type = std::string;
+    };
+
+    template <>
+    struct captured<char *>
+    {
+        using type = std::string;
+    };
+
+    //! Arguments of a single log message, captured by value
+    template <typename... Args>
+    class capturedArguments : public argumentPack
+    {
+        public:
+            capturedArguments(const Args &... args) : m_args(args...)
+            {
+            }
+
+            boost::format &apply(boost::format &fmt) const override
+            {
+                return apply(fmt, std::index_sequence_for<Args...>());
+            }
+
+        private:
+            template <size_t... I>
+            boost::format &apply(boost::format &fmt, std::index_sequence<I...>) const
+            {
+                return print(fmt, std::get<I>(m_args)...);
+            }
+
+            std::tuple<typename captured<std::decay_t<Args>>::type...> m_args;
+    };
+}
+
+#endif//_LOG_ARGUMENTS_H_
@@ -0,0 +1,93 @@
+/**
+ * @file   log_binary.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Binary log stream format.
+ * @details Record layout shared by the binary log back end and the `logxx-decode` tool
+ *
+ * A stream starts with a header, followed by records that each begin with a one byte tag. Values are stored in host
+ * byte order, strings as a 32 bit length followed by the bytes.
+ *
+ * | Record     | Contents                                                                              |
+ * |------------|---------------------------------------------------------------------------------------|
+ * | header     | magic `LXXB`, version, clock period numerator and denominator                         |
+ * | callsite   | hash, line, level, file, function, extended function, class, module                   |
+ * | thread     | thread index, thread ID as text                                                       |
+ * | message    | callsite hash, clock ticks since the epoch, thread index, level, formatted message    |
+ *
+ * Call site and thread records are written once, before the first message that refers to them.
+ */
+
+#pragma once
+#ifndef _LOG_BINARY_H_
+#define _LOG_BINARY_H_
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+
+namespace LogXX
+{
+    namespace binary
+    {
+        static const char     magic[4] = {'L', 'X', 'X', 'B'};
+        static const uint32_t version  = 1;
+
+        //! Record tags
+        enum tags : uint8_t
+        {
+            TAG_CALLSITE = 1,   //!< call site dictionary entry
+            TAG_THREAD   = 2,   //!< thread dictionary entry
+            TAG_MESSAGE  = 3    //!< log message
+        };
+
+        //! Append a trivially copyable value to a record
+        template <typename T>
+        inline void append(std::string &record, const T &value)
+        {
+            record.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        //! Append a length prefixed string to a record
+        inline void appendString(std::string &record, const char *str, size_t length)
+        {
+            append(record, static_cast<uint32_t>(length));
+            record.append(str, length);
+        }
+
+        inline void appendString(std::string &record, const char *str)
+        {
+            appendString(record, str, std::strlen(str));
+        }
+
+        inline void appendString(std::string &record, const std::string &str)
+        {
+            appendString(record, str.data(), str.size());
+        }
+
+        //! Read a trivially copyable value
+        template <typename T>
+        inline bool read(std::istream &is, T &value)
+        {
+            return static_cast<bool>(is.read(reinterpret_cast<char *>(&value), sizeof(value)));
+        }
+
+        //! Read a length prefixed string
+        inline bool readString(std::istream &is, std::string &str)
+        {
+            uint32_t length;
+
+            if(!read(is, length))
+            {
+                return false;
+            }
+
+            str.resize(length);
+            return length == 0 || static_cast<bool>(is.read(&str[0], length));
+        }
+    }
+}
+
+#endif//_LOG_BINARY_H_
@@ -0,0 +1,112 @@
+/**
+ * @file   log_clock.cpp
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Cycle counter time stamps.
+ * @details Lets producers stamp messages with the CPU time stamp counter instead of reading the system clock, the log
+ *          thread turns the counts into wall clock time before any back end sees the message
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "log_clock.h"
+
+#if defined(LOGXX_HAVE_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace LogXX
+{
+    std::atomic<bool> tscClock::m_enabled(false);
+
+    bool tscClock::available()
+    {
+#ifdef LOGXX_HAVE_TSC
+        // CPUID 0x80000007, EDX bit 8: the counter ticks at a constant rate in every P, C and T state
+        unsigned int registers[4] = {0, 0, 0, 0};
+
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0x80000000);
+
+        if(static_cast<unsigned int>(info[0]) >= 0x80000007)
+        {
+            __cpuid(info, 0x80000007);
+            registers[3] = static_cast<unsigned int>(info[3]);
+        }
+#else
+        if(__get_cpuid_max(0x80000000, nullptr) >= 0x80000007)
+        {
+            __get_cpuid(0x80000007, &registers[0], &registers[1], &registers[2], &registers[3]);
+        }
+#endif
+
+        return (registers[3] & (1u << 8)) != 0;
+#else
+        return false;
+#endif
+    }
+
+    bool tscClock::enable(bool enable)
+    {
+        if(enable && !available())
+        {
+            return false;
+        }
+
+        m_enabled.store(enable);
+        return true;
+    }
+
+    tscClock::sample tscClock::pair()
+    {
+        // Bracket the clock read with two counter reads and use the midpoint
+        sample result;
+        uint64_t before(ticks());
+        result.time = std::chrono::system_clock::now();
+        uint64_t after(ticks());
+
+        result.ticks = before + (after - before) / 2;
+        return result;
+    }
+
+    void tscClock::calibrate(std::chrono::steady_clock::duration interval)
+    {
+        auto now(std::chrono::steady_clock::now());
+
+        if(m_clockPerTick == 0)
+        {
+            // First use, measure a rate over a short interval to get going
+            m_first = pair();
+            m_started = now;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        else if(now - m_calibrated < std::min(interval, m_calibrated - m_started))
+        {
+            // Early on the rate comes from a short interval, so recalibrate every time the span it was measured over
+            // could double, then settle down to `interval`
+            return;
+        }
+
+        m_latest = pair();
+        m_calibrated = std::chrono::steady_clock::now();
+
+        if(m_latest.ticks != m_first.ticks)
+        {
+            m_clockPerTick = static_cast<double>((m_latest.time - m_first.time).count()) /
+                             static_cast<double>(m_latest.ticks - m_first.ticks);
+        }
+    }
+
+    std::chrono::system_clock::time_point tscClock::toSystem(uint64_t ticks)
+    {
+        // Signed, messages stamped before the latest calibration are converted too
+        auto elapsed(static_cast<int64_t>(ticks - m_latest.ticks));
+
+        return m_latest.time + std::chrono::system_clock::duration(
+                   static_cast<std::chrono::system_clock::rep>(std::llround(elapsed * m_clockPerTick)));
+    }
+}
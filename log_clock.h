@@ -0,0 +1,108 @@
+/**
+ * @file   log_clock.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Cycle counter time stamps and a coarse clock for rate limits.
+ * @details Lets producers stamp messages with the CPU time stamp counter instead of reading the system clock, the log
+ *          thread turns the counts into wall clock time before any back end sees the message
+ */
+
+#pragma once
+#ifndef _LOG_CLOCK_H_
+#define _LOG_CLOCK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define LOGXX_HAVE_TSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define LOGXX_HAVE_TSC
+#endif
+
+namespace LogXX
+{
+    //! Time stamp counter clock
+    //! \details Producers only read the counter, see ticks(). The log thread owns the calibration, it pairs counter readings
+    //!          with `system_clock` now and then and converts counts with the rate measured between the first and the
+    //!          latest pairing. Only used when the counter runs at a constant rate regardless of power states, checked
+    //!          with CPUID, otherwise messages keep using `system_clock`.
+    class tscClock
+    {
+        public:
+            //! True if this CPU has an invariant time stamp counter
+            static bool available();
+
+            //! Switch producers over to the counter, or back to `system_clock`
+            //! \return false if the counter can't be used, producers stay on `system_clock`
+            static bool enable(bool enable);
+
+            //! True while producers stamp messages with the counter
+            static bool enabled()
+            {
+                return m_enabled.load(std::memory_order_relaxed);
+            }
+
+            //! Read the counter, 0 if there is none
+            static uint64_t ticks()
+            {
+#ifdef LOGXX_HAVE_TSC
+                return __rdtsc();
+#else
+                return 0;
+#endif
+            }
+
+            //! Take a new calibration pairing if the last one is more than `interval` old, log thread only
+            //! \note The first call measures the rate over 10ms, then recalibrates at growing intervals up to `interval`
+            void calibrate(std::chrono::steady_clock::duration interval = std::chrono::seconds(1));
+
+            //! Convert a counter reading to wall clock time, log thread only
+            std::chrono::system_clock::time_point toSystem(uint64_t ticks);
+
+        private:
+            //! A counter reading and the wall clock time it was taken at
+            struct sample
+            {
+                uint64_t                                ticks = 0;
+                std::chrono::system_clock::time_point   time;
+            };
+
+            //! Read the counter and the system clock as close together as possible
+            static sample pair();
+
+            static std::atomic<bool> m_enabled;
+
+            sample                                  m_first;            //!< rate is measured from here
+            sample                                  m_latest;           //!< conversions are made from here
+            double                                  m_clockPerTick = 0; //!< `system_clock` ticks per counter tick
+            std::chrono::steady_clock::time_point   m_started;          //!< when m_first was taken
+            std::chrono::steady_clock::time_point   m_calibrated;       //!< when m_latest was taken
+    };
+
+    //! Cheap monotonic clock with a resolution of a few milliseconds
+    //! \details Good enough for rate limits, on Linux reading it costs about as much as a load from the vDSO page
+    class coarseClock
+    {
+        public:
+            //! Nanoseconds since an arbitrary point, never goes backwards
+            static int64_t now()
+            {
+#ifdef CLOCK_MONOTONIC_COARSE
+                timespec now;
+                ::clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+                return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+            }
+    };
+}
+
+#endif//_LOG_CLOCK_H_
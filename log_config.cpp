@@ -11,11 +11,80 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <queue>
 #include "log_config.h"
 
 namespace LogXX
 {
-    configuration::configuration(const boost::filesystem::path &path) : m_defaultLevel(LOG_NONE)
+    levelCache::levelCache(size_t capacity)
+        : m_mask(1)
+    {
+        while(m_mask < capacity)
+        {
+            m_mask <<= 1;
+        }
+
+        m_slots.reset(new slot[m_mask]);
+        --m_mask;
+    }
+
+    bool levelCache::find(uint64_t hash, levels &level) const
+    {
+        auto index(home(hash));
+
+        for(size_t probe(0); probe < maxProbes; ++probe, index = (index + 1) & m_mask)
+        {
+            uint64_t slotHash(m_slots[index].hash.load(std::memory_order_acquire));
+
+            if(slotHash == hash && hash != 0)
+            {
+                uint8_t slotLevel(m_slots[index].level.load(std::memory_order_acquire));
+
+                if(slotLevel == pending)
+                {
+                    return false;
+                }
+
+                level = static_cast<levels>(slotLevel);
+                return true;
+            }
+
+            if(slotHash == 0)
+            {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    void levelCache::insert(uint64_t hash, levels level)
+    {
+        if(hash == 0)
+        {
+            return;
+        }
+
+        auto index(home(hash));
+
+        for(size_t probe(0); probe < maxProbes; ++probe, index = (index + 1) & m_mask)
+        {
+            uint64_t slotHash(0);
+
+            if(m_slots[index].hash.compare_exchange_strong(slotHash, hash, std::memory_order_acq_rel) || slotHash == hash)
+            {
+                m_slots[index].level.store(static_cast<uint8_t>(level), std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    constexpr size_t  levelCache::maxProbes;
+    constexpr uint8_t levelCache::pending;
+
+    // Without a configuration file everything is logged
+    configuration::configuration(const boost::filesystem::path &path) : m_defaultLevel(LOG_ALL)
     {
         if(!path.empty())
         {
@@ -31,81 +100,184 @@ namespace LogXX
                 m_configuration = normalizePTree(m_configuration);
             }
         }
+
+        m_rules.emplace_back();
+        compileRules(m_configuration, 0);
+    }
+
+    std::string configuration::ruleKey(ruleKind kind, const std::string &name)
+    {
+        std::string key(1, kind);
+        key += boost::algorithm::to_lower_copy(name);
+        return key;
     }
 
-    bool configuration::logMessage(const std::shared_ptr<message> msg)
+    bool configuration::compileRules(const boost::property_tree::ptree &node, uint32_t index)
     {
-        uint hash(msg->getHash());
+        bool hasRules(false);
 
-        if(m_messageCache.count(hash) == 0)
+        if(node.count("level") > 0)
         {
-            m_messageCache[hash] = getLevel(msg);
+            m_rules[index].hasLevel = hasRules = true;
+            m_rules[index].level = message::stringToLevel(node.get<std::string>("level"));
         }
 
-        return msg->getLevel() >= m_messageCache[hash];
-    }
-
-    levels configuration::getLevel(const std::shared_ptr<message> msg)
-    {
-        levels level(m_defaultLevel);
+        if(node.count("rate") > 0)
+        {
+            auto &limit(m_rules[index].limit);
 
-        std::queue<boost::property_tree::ptree> treeQueue;
-        treeQueue.push(m_configuration);
+            m_rules[index].hasRate = hasRules = true;
+            limit.rate = node.get<double>("rate");
+            limit.burst = node.get<double>("burst", std::max(limit.rate, 1.0));
+        }
 
-        while(!treeQueue.empty())
+        for(const auto &child : node)
         {
-            auto &node(treeQueue.front());
+            // Rules are added depth first, so the children of a node are numbered in the order they appear
+            uint32_t childIndex(static_cast<uint32_t>(m_rules.size()));
+            m_rules.emplace_back();
 
-            if(node.count("level") > 0)
+            if(!compileRules(child.second, childIndex))
             {
-                level = message::stringToLevel(node.get<std::string>("level"));
+                m_rules.resize(childIndex);
+                continue;
             }
 
-            for(const auto &child : node)
+            hasRules = true;
+
+            if(child.second.count("name") == 0)
             {
-                bool enqueue(false);
+                m_rules[index].always.push_back(childIndex);
+                continue;
+            }
 
-                if(child.second.count("name") == 0)
-                {
-                    enqueue = true;
-                }
-                else
-                {
-                    std::string messageName;
+            auto name(child.second.get<std::string>("name"));
+            ruleKind kind;
 
-                    if(boost::algorithm::iequals(child.first, "module"))
-                    {
-                        messageName = msg->getModule();
-                    }
-                    else if(boost::algorithm::iequals(child.first, "file"))
-                    {
-                        messageName = msg->getFile().generic_string();
-                    }
-                    else if(boost::algorithm::iequals(child.first, "function"))
-                    {
-                        messageName = msg->getFunction();
-                    }
-                    else if(boost::algorithm::iequals(child.first, "class"))
-                    {
-                        messageName = msg->getClass();
-                    }
+            if(boost::algorithm::iequals(child.first, "module"))
+            {
+                kind = RULE_MODULE;
+            }
+            else if(boost::algorithm::iequals(child.first, "file"))
+            {
+                kind = RULE_FILE;
+            }
+            else if(boost::algorithm::iequals(child.first, "function"))
+            {
+                kind = RULE_FUNCTION;
+            }
+            else if(boost::algorithm::iequals(child.first, "class"))
+            {
+                kind = RULE_CLASS;
+            }
+            else if(name.empty())
+            {
+                // Other kinds are compared against an empty name
+                m_rules[index].always.push_back(childIndex);
+                continue;
+            }
+            else
+            {
+                m_rules.resize(childIndex);
+                continue;
+            }
 
-                    enqueue = boost::algorithm::iequals(messageName, child.second.get<std::string>("name"));
+            m_rules[index].named[ruleKey(kind, name)].push_back(childIndex);
+        }
 
-                }
+        return hasRules;
+    }
+
+    bool configuration::logMessage(const std::shared_ptr<message> &msg)
+    {
+        return msg->getLevel() <= getMessageLevel(msg);
+    }
+
+    levels configuration::getMessageLevel(const std::shared_ptr<message> &msg)
+    {
+        levels level;
+
+        if(!m_messageCache.find(msg->getHash(), level))
+        {
+            // Threads racing on the same call site all get the same answer, whichever is cached doesn't matter
+            level = getLevel(msg);
+            m_messageCache.insert(msg->getHash(), level);
+        }
+
+        return level;
+    }
+
+    template <typename Visit>
+    void configuration::matchRules(const std::shared_ptr<message> &msg, Visit visit) const
+    {
+        const std::string keys[] =
+        {
+            ruleKey(RULE_MODULE, msg->getModule()),
+            ruleKey(RULE_FILE, msg->getFile().generic_string()),
+            ruleKey(RULE_FUNCTION, msg->getFunction()),
+            ruleKey(RULE_CLASS, msg->getClass())
+        };
+
+        // Breadth first over the rules that match
+        std::vector<uint32_t> ruleQueue(1, 0);
+
+        for(size_t next(0); next < ruleQueue.size(); ++next)
+        {
+            const auto &node(m_rules[ruleQueue[next]]);
+            auto first(ruleQueue.size());
+
+            visit(node);
 
-                if(enqueue)
+            ruleQueue.insert(ruleQueue.end(), node.always.begin(), node.always.end());
+
+            if(!node.named.empty())
+            {
+                for(const auto &key : keys)
                 {
-                    treeQueue.push(child.second);
+                    auto children(node.named.find(key));
+
+                    if(children != node.named.end())
+                    {
+                        ruleQueue.insert(ruleQueue.end(), children->second.begin(), children->second.end());
+                    }
                 }
-            }
 
-            treeQueue.pop();
+                std::sort(ruleQueue.begin() + first, ruleQueue.end());
+            }
         }
+    }
+
+    levels configuration::getLevel(const std::shared_ptr<message> &msg) const
+    {
+        levels level(m_defaultLevel);
+
+        // The last level found wins
+        matchRules(msg, [&level](const rule &node)
+        {
+            if(node.hasLevel)
+            {
+                level = node.level;
+            }
+        });
 
         return level;
     }
 
+    rateLimit configuration::getRateLimit(const std::shared_ptr<message> &msg) const
+    {
+        rateLimit limit;
+
+        matchRules(msg, [&limit](const rule &node)
+        {
+            if(node.hasRate)
+            {
+                limit = node.limit;
+            }
+        });
+
+        return limit;
+    }
+
     boost::property_tree::ptree configuration::getBackends() const
     {
         boost::property_tree::ptree backends;
@@ -12,6 +12,10 @@
 #define _LOG_CONFIG_H_
 
 #include<unordered_map>
+#include<atomic>
+#include<memory>
+#include<vector>
+#include<string>
 #include<boost/property_tree/ptree.hpp>
 #include<boost/filesystem.hpp>
 
@@ -19,6 +23,51 @@
 
 namespace LogXX
 {
+    //! Cache of the level configured for each call site, keyed by the full 64 bit call site hash
+    //! \details An open addressed table that any number of threads can use at once without locks. Lookups look at no more
+    //!          than `maxProbes` slots, so they are wait free. A slot is claimed by setting its hash, the level is
+    //!          published after it, until then readers treat the slot as a miss. Entries are never removed, when a
+    //!          call site finds no free slot its level simply isn't cached.
+    class levelCache
+    {
+        public:
+            explicit levelCache(size_t capacity = 4096);
+
+            //! Look up the level cached for `hash`
+            //! \return false if there is none
+            bool find(uint64_t hash, levels &level) const;
+
+            //! Cache the level for `hash`
+            void insert(uint64_t hash, levels level);
+
+        private:
+            static constexpr size_t  maxProbes = 16;
+            static constexpr uint8_t pending = 0xff;    //!< slot claimed, level not written yet
+
+            struct slot
+            {
+                std::atomic<uint64_t>   hash{0};        //!< 0 marks a free slot, a call site hashing to 0 isn't cached
+                std::atomic<uint8_t>    level{pending};
+            };
+
+            //! First slot to look at for `hash`
+            size_t home(uint64_t hash) const
+            {
+                // Fibonacci hashing, spreads hashes that only differ in a few bits
+                return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> 32) & m_mask;
+            }
+
+            std::unique_ptr<slot[]> m_slots;
+            size_t                  m_mask;
+    };
+
+    //! Rate limit for a call site, from the `rate` and `burst` keys of the configuration
+    struct rateLimit
+    {
+        double rate = 0;    //!< messages per second, 0 for no limit
+        double burst = 0;   //!< messages that may be logged at once after a quiet spell
+    };
+
     //! Configuration file reader
     class configuration
     {
@@ -27,9 +76,14 @@ namespace LogXX
             configuration(const boost::filesystem::path &path);
 
             //! check if debug message is enabled or not, cache results
-            bool logMessage(const std::shared_ptr<message> msg);
+            bool logMessage(const std::shared_ptr<message> &msg);
+
+            //! Get the log level enabled for the location a message was logged from, cache results
+            //! \note Safe to call from any number of threads at once
+            levels getMessageLevel(const std::shared_ptr<message> &msg);
 
             //! set default log level
+            //! \note Levels already cached are kept, call this before any messages are logged
             levels setDefaultLogLevel(levels level)
             {
                 m_defaultLevel = level;
@@ -38,15 +92,55 @@ namespace LogXX
 
             //! Return list of log back ends and their configuration
             boost::property_tree::ptree getBackends() const;
+
+            //! Get the log level that is enabled for a given message, without caching
+            levels getLevel(const std::shared_ptr<message> &msg) const;
+
+            //! Get the rate limit for the location a message was logged from, without caching
+            //! \details Set with `rate`, in messages per second, and `burst`, which defaults to one second's worth of
+            //!          messages. Inherited like levels, the most specific rule with a rate wins.
+            rateLimit getRateLimit(const std::shared_ptr<message> &msg) const;
+
         private:
-            //! Get the log level that is enabled for a given message
-            levels getLevel(const std::shared_ptr<message> msg);
+            //! Names a rule can match a message on
+            enum ruleKind : char
+            {
+                RULE_MODULE = 'm',
+                RULE_FILE = 'f',
+                RULE_FUNCTION = 'u',
+                RULE_CLASS = 'c'
+            };
+
+            //! A configuration node, compiled for lookups
+            //! \details Children are found by kind and lower case name, `ruleKind` followed by the name, instead of
+            //!          comparing every child of every node. Rules are numbered in document order, so sorting the
+            //!          matching children gives the same order a walk of the tree would.
+            struct rule
+            {
+                bool                                                    hasLevel = false;
+                levels                                                  level = LOG_NONE;
+                bool                                                    hasRate = false;
+                rateLimit                                               limit;
+                std::vector<uint32_t>                                   always;     //!< children without a name
+                std::unordered_map<std::string, std::vector<uint32_t>>  named;      //!< children by kind and name
+            };
 
             //! Helper function to "promote" xml attributes to simple nodes
             boost::property_tree::ptree normalizePTree(const boost::property_tree::ptree &tree);
 
-            std::unordered_map<uint64_t, levels> m_messageCache;
+            //! Lookup key for a rule, case is folded so names match regardless of case
+            static std::string ruleKey(ruleKind kind, const std::string &name);
+
+            //! Compile `node` and everything under it into m_rules, false if it holds no levels or rates and can be skipped
+            bool compileRules(const boost::property_tree::ptree &node, uint32_t index);
+
+            //! Call `visit` with every rule that matches a message, least specific first
+            template <typename Visit>
+            void matchRules(const std::shared_ptr<message> &msg, Visit visit) const;
+
+            levelCache                           m_messageCache;
             boost::property_tree::ptree          m_configuration;
+            std::vector<rule>                    m_rules;           //!< m_configuration compiled, the root is m_rules[0]
             levels                               m_defaultLevel;
     };
 }
@@ -0,0 +1,172 @@
+/**
+ * @file   log_decode.cpp
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Binary log decoder.
+ * @details Turns a stream written by the `logBinary` back end into the usual text log
+ *
+ * Usage: `logxx-decode <binary log> [header format]`, the header format defaults to `"%1% %2% %3% [%4%] %5% %7%"`
+ */
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "date/date.h"
+#include "log_message.h"
+#include "log_binary.h"
+
+namespace
+{
+    //! Call site dictionary entry
+    struct callsiteInfo
+    {
+        uint32_t                line;
+        uint8_t                 level;
+        boost::filesystem::path file;
+        std::string             function;
+        std::string             extendedFunction;
+        std::string             className;
+        std::string             module;
+    };
+
+    //! Render a message header the same way `LogXX::message::getMessageHeader` does
+    boost::format formatHeader(const std::string &formatStr, std::chrono::system_clock::time_point logTime, LogXX::levels level,
+                               const std::string &threadID, const callsiteInfo &site)
+    {
+        auto log_date(date::floor<date::days>(logTime));
+        auto date = date::year_month_day{log_date};
+        auto time(date::make_time(logTime - log_date));
+
+        boost::format header(formatStr);
+        header.exceptions(boost::io::all_error_bits ^ (boost::io::too_few_args_bit | boost::io::too_many_args_bit));
+
+        header % date
+               % time
+               % LogXX::message::levelToString(level)
+               % threadID
+               % site.file.filename()
+               % site.file
+               % (site.extendedFunction.empty() ? site.function : site.extendedFunction)
+               % site.function
+               % site.extendedFunction;
+
+        return header;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <binary log> [header format]" << std::endl;
+        return 1;
+    }
+
+    std::string headerFormat(argc > 2 ? argv[2] : LogXX::message::defaultHeaderFormat);
+    boost::filesystem::ifstream is(boost::filesystem::path(argv[1]), std::ios::binary);
+
+    char magic[sizeof(LogXX::binary::magic)];
+    uint32_t version;
+    int64_t periodNum, periodDen;
+
+    if(!is.read(magic, sizeof(magic)) || std::memcmp(magic, LogXX::binary::magic, sizeof(magic)) != 0 ||
+       !LogXX::binary::read(is, version) || version != LogXX::binary::version ||
+       !LogXX::binary::read(is, periodNum) || !LogXX::binary::read(is, periodDen))
+    {
+        std::cerr << argv[1] << ": not a LoggerXX binary log" << std::endl;
+        return 1;
+    }
+
+    std::unordered_map<uint64_t, callsiteInfo> callsites;
+    std::unordered_map<uint32_t, std::string> threads;
+    std::string body;
+    uint8_t tag;
+
+    while(LogXX::binary::read(is, tag))
+    {
+        bool ok(false);
+
+        switch(tag)
+        {
+            case LogXX::binary::TAG_CALLSITE:
+            {
+                uint64_t hash;
+                callsiteInfo site;
+                std::string file;
+
+                ok = LogXX::binary::read(is, hash) &&
+                     LogXX::binary::read(is, site.line) &&
+                     LogXX::binary::read(is, site.level) &&
+                     LogXX::binary::readString(is, file) &&
+                     LogXX::binary::readString(is, site.function) &&
+                     LogXX::binary::readString(is, site.extendedFunction) &&
+                     LogXX::binary::readString(is, site.className) &&
+                     LogXX::binary::readString(is, site.module);
+
+                site.file = file;
+                callsites[hash] = site;
+                break;
+            }
+
+            case LogXX::binary::TAG_THREAD:
+            {
+                uint32_t index;
+                std::string threadID;
+
+                ok = LogXX::binary::read(is, index) && LogXX::binary::readString(is, threadID);
+                threads[index] = threadID;
+                break;
+            }
+
+            case LogXX::binary::TAG_MESSAGE:
+            {
+                uint64_t hash;
+                int64_t ticks;
+                uint32_t thread;
+                uint8_t level;
+
+                ok = LogXX::binary::read(is, hash) &&
+                     LogXX::binary::read(is, ticks) &&
+                     LogXX::binary::read(is, thread) &&
+                     LogXX::binary::read(is, level) &&
+                     LogXX::binary::readString(is, body);
+
+                if(ok)
+                {
+                    std::chrono::system_clock::time_point logTime;
+
+                    if(periodNum == std::chrono::system_clock::period::num && periodDen == std::chrono::system_clock::period::den)
+                    {
+                        logTime += std::chrono::system_clock::duration(ticks);
+                    }
+                    else
+                    {
+                        // Convert ticks from the clock of the process that wrote the log
+                        std::chrono::duration<long double> sinceEpoch(static_cast<long double>(ticks) * periodNum / periodDen);
+                        logTime += std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceEpoch);
+                    }
+
+                    std::cout << formatHeader(headerFormat, logTime, static_cast<LogXX::levels>(level), threads[thread], callsites[hash])
+                              << ' ' << body << '\n';
+                }
+
+                break;
+            }
+        }
+
+        if(!ok)
+        {
+            std::cerr << argv[1] << ": truncated or corrupt record" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
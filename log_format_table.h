@@ -0,0 +1,407 @@
+/**
+ * @file   log_format_table.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Compile time parsed log format strings.
+ * @details Parses a literal `boost::format` string into a table of text and argument segments at compile time, so the
+ *          `_log` macros can check the argument count while compiling and format without parsing, see
+ *          `LOGXX_STATIC_FORMAT`
+ */
+
+#pragma once
+#ifndef _LOG_FORMAT_TABLE_H_
+#define _LOG_FORMAT_TABLE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <boost/format.hpp>
+
+#include "log_format.h"
+
+namespace LogXX
+{
+    //! A literal format string split into text and argument segments
+    //! \details Understands everything `boost::format` does well enough to count the arguments and reject strings it
+    //!          would throw on. Formats made of text, `%%`, `%N%` and bare `%s`, `%d`, `%i` or `%u` directives are simple,
+    //!          those can be rendered straight from the table, anything with flags, widths or other conversions is
+    //!          left to `boost::format`.
+    template <size_t N>
+    class formatTable
+    {
+        public:
+            static_assert(N < UINT16_MAX, "log format string too long");
+
+            //! A run of format text, or an argument
+            struct segment
+            {
+                uint16_t    offset;     //!< start of the text in the format string
+                uint16_t    length;     //!< length of the text, 0 for an argument
+                uint16_t    argument;   //!< zero based argument number
+            };
+
+            constexpr formatTable(const char (&text)[N])
+                : m_text(text)
+                , m_segments{}
+                , m_count(0)
+                , m_arguments(0)
+                , m_valid(true)
+                , m_simple(true)
+            {
+                parse();
+            }
+
+            constexpr const char *text()      const { return m_text; }       //!< The format string
+            constexpr size_t      arguments() const { return m_arguments; }  //!< Number of arguments the format expects
+            constexpr bool        valid()     const { return m_valid; }      //!< False if `boost::format` would reject the format
+            constexpr bool        simple()    const { return m_simple; }     //!< True if render() can format it
+
+            //! Append the formatted text to `out`
+            //! \pre simple() and one argument for each of arguments()
+            template <typename... Args>
+            void render(std::string &out, const Args &... args) const;
+
+        private:
+            static constexpr bool isDigit(char c)
+            {
+                return c >= '0' && c <= '9';
+            }
+
+            //! Flags, width, precision and length modifiers that may come between `%` and the conversion
+            static constexpr bool isSpecification(char c)
+            {
+                return isDigit(c) || c == '-' || c == '+' || c == ' ' || c == '#' || c == '\'' || c == '.' ||
+                       c == 'h' || c == 'l' || c == 'L' || c == 'j' || c == 'z';
+            }
+
+            constexpr void addText(size_t offset, size_t length)
+            {
+                if(m_count != 0 && m_segments[m_count - 1].length != 0 &&
+                   m_segments[m_count - 1].offset + m_segments[m_count - 1].length == offset)
+                {
+                    m_segments[m_count - 1].length += static_cast<uint16_t>(length);
+                }
+                else
+                {
+                    m_segments[m_count++] = {static_cast<uint16_t>(offset), static_cast<uint16_t>(length), 0};
+                }
+            }
+
+            constexpr void addArgument(size_t argument)
+            {
+                m_segments[m_count++] = {0, 0, static_cast<uint16_t>(argument)};
+            }
+
+            constexpr void parse()
+            {
+                const size_t length(N - 1);
+                bool positional(false);
+                bool sequential(false);
+                size_t i(0);
+
+                while(i < length && m_valid)
+                {
+                    if(m_text[i] != '%')
+                    {
+                        size_t start(i);
+
+                        while(i < length && m_text[i] != '%')
+                        {
+                            ++i;
+                        }
+
+                        addText(start, i - start);
+                        continue;
+                    }
+
+                    if(i + 1 >= length)
+                    {
+                        m_valid = false;
+                        break;
+                    }
+
+                    if(m_text[i + 1] == '%')
+                    {
+                        // The second '%' is the text
+                        addText(i + 1, 1);
+                        i += 2;
+                        continue;
+                    }
+
+                    size_t j(i + 1);
+                    size_t number(0);
+                    bool numbered(false);
+
+                    if(m_text[j] == '|')
+                    {
+                        // %|spec|, positional if the spec starts with N$
+                        m_simple = false;
+                        ++j;
+
+                        size_t digits(j);
+
+                        while(j < length && isDigit(m_text[j]))
+                        {
+                            number = number * 10 + (m_text[j++] - '0');
+                        }
+
+                        numbered = j > digits && j < length && m_text[j] == '$';
+
+                        while(j < length && m_text[j] != '|')
+                        {
+                            ++j;
+                        }
+
+                        if(j >= length)
+                        {
+                            m_valid = false;
+                            break;
+                        }
+
+                        ++j;
+                    }
+                    else
+                    {
+                        size_t digits(j);
+
+                        while(j < length && isDigit(m_text[j]))
+                        {
+                            number = number * 10 + (m_text[j++] - '0');
+                        }
+
+                        if(j > digits && j < length && m_text[j] == '%')
+                        {
+                            // %N%
+                            numbered = true;
+                            ++j;
+                        }
+                        else
+                        {
+                            if(j > digits && j < length && m_text[j] == '$')
+                            {
+                                numbered = true;
+                                ++j;
+                            }
+                            else
+                            {
+                                // The digits were a width, start the specification over
+                                j = digits;
+                            }
+
+                            size_t specification(j);
+
+                            while(j < length && isSpecification(m_text[j]))
+                            {
+                                ++j;
+                            }
+
+                            if(j >= length)
+                            {
+                                m_valid = false;
+                                break;
+                            }
+
+                            char conversion(m_text[j++]);
+
+                            if(numbered || j - 1 != specification ||
+                               (conversion != 's' && conversion != 'd' && conversion != 'i' && conversion != 'u'))
+                            {
+                                m_simple = false;
+                            }
+                        }
+                    }
+
+                    if(numbered)
+                    {
+                        if(number == 0)
+                        {
+                            m_valid = false;
+                            break;
+                        }
+
+                        positional = true;
+                        addArgument(number - 1);
+                        m_arguments = number > m_arguments ? number : m_arguments;
+                    }
+                    else
+                    {
+                        sequential = true;
+                        addArgument(m_arguments++);
+                    }
+
+                    i = j;
+                }
+
+                // boost::format doesn't allow mixing "%1%" and "%s" style arguments
+                if(positional && sequential)
+                {
+                    m_valid = false;
+                }
+
+                if(!m_valid)
+                {
+                    m_simple = false;
+                }
+            }
+
+            const char  *m_text;
+            segment      m_segments[N];
+            size_t       m_count;
+            size_t       m_arguments;
+            bool         m_valid;
+            bool         m_simple;
+    };
+
+    //! Argument count of a `_log` macro, in an unevaluated context
+    //! \details `decltype(formatArguments(__VA_ARGS__))::value` is the number of arguments after the format string
+    template <typename Format, typename... Args>
+    std::integral_constant<size_t, sizeof...(Args)> formatArguments(const Format &, const Args &...);
+
+    namespace detail
+    {
+        //! Types written straight into the output, everything else goes through print()
+        //! \note print() overloads for these types are not used by the compiled formats
+        template <typename T>
+        using directNumber = std::integral_constant<bool, std::is_arithmetic<T>::value &&
+                                                    !std::is_same<T, bool>::value &&
+                                                    !std::is_same<T, char>::value &&
+                                                    !std::is_same<T, signed char>::value &&
+                                                    !std::is_same<T, unsigned char>::value &&
+                                                    !std::is_same<T, wchar_t>::value &&
+                                                    !std::is_same<T, char16_t>::value &&
+                                                    !std::is_same<T, char32_t>::value>;
+
+        //! Same text as streaming the value with default stream flags
+        template <typename T>
+        std::enable_if_t<directNumber<T>::value && std::is_integral<T>::value> appendArgument(std::string &out, boost::format &, const T &value)
+        {
+            out += std::to_string(value);
+        }
+
+        inline void appendArgument(std::string &out, boost::format &, double value)
+        {
+            char text[32];
+            out.append(text, std::snprintf(text, sizeof(text), "%.6g", value));
+        }
+
+        inline void appendArgument(std::string &out, boost::format &slot, float value)
+        {
+            appendArgument(out, slot, static_cast<double>(value));
+        }
+
+        inline void appendArgument(std::string &out, boost::format &, long double value)
+        {
+            char text[48];
+            out.append(text, std::snprintf(text, sizeof(text), "%.6Lg", value));
+        }
+
+        inline void appendArgument(std::string &out, boost::format &, const std::string &value)
+        {
+            out += value;
+        }
+
+        inline void appendArgument(std::string &out, boost::format &, const char *value)
+        {
+            out += value;
+        }
+
+        //! Anything else is fed to the `print()` extension points through a single argument format
+        template <typename T>
+        std::enable_if_t<!directNumber<T>::value> appendArgument(std::string &out, boost::format &slot, const T &value)
+        {
+            slot.clear();
+            print(slot, value);
+            out += slot.str();
+        }
+
+        template <size_t N>
+        void appendArgument(std::string &out, boost::format &, const char (&value)[N])
+        {
+            out += value;
+        }
+
+        //! Argument text and `print()` slot a render() works in
+        struct renderBuffer
+        {
+            boost::format   slot{"%1%"};
+            std::string     arguments;
+            bool            busy = false;   //!< in use by a render(), a nested one gets a buffer of its own
+        };
+
+        //! Holds the thread's renderBuffer for one render(), so its capacity is reused from one message to the next
+        //! \note A `print()` overload that logs renders another message part way through, that one gets a buffer of its
+        //!       own rather than clearing the one the outer render() is using
+        class renderScope
+        {
+            public:
+                renderScope()
+                    : m_buffer(&threadBuffer())
+                {
+                    if(m_buffer->busy)
+                    {
+                        m_nested = std::make_unique<renderBuffer>();
+                        m_buffer = m_nested.get();
+                    }
+
+                    m_buffer->busy = true;
+                    m_buffer->arguments.clear();
+                }
+
+                ~renderScope()
+                {
+                    m_buffer->busy = false;
+                }
+
+                renderScope(const renderScope &) = delete;
+                renderScope &operator=(const renderScope &) = delete;
+
+                renderBuffer &buffer()
+                {
+                    return *m_buffer;
+                }
+
+            private:
+                static renderBuffer &threadBuffer()
+                {
+                    thread_local renderBuffer buffer;
+                    return buffer;
+                }
+
+                renderBuffer                   *m_buffer;
+                std::unique_ptr<renderBuffer>   m_nested;   //!< owns m_buffer when the thread's buffer was busy
+        };
+    }
+
+    template <size_t N>
+    template <typename... Args>
+    void formatTable<N>::render(std::string &out, const Args &... args) const
+    {
+        // Arguments may be used more than once or out of order, so render each one once up front
+        detail::renderScope scope;
+        auto &slot(scope.buffer().slot);
+        auto &arguments(scope.buffer().arguments);
+        size_t bounds[sizeof...(Args) + 1] = {0};
+        size_t argument(0);
+
+        int expand[] = {0, (detail::appendArgument(arguments, slot, args), bounds[++argument] = arguments.size(), 0)...};
+        static_cast<void>(expand);
+
+        for(size_t s = 0; s < m_count; ++s)
+        {
+            const auto &item(m_segments[s]);
+
+            if(item.length != 0)
+            {
+                out.append(m_text + item.offset, item.length);
+                continue;
+            }
+
+            out.append(arguments, bounds[item.argument], bounds[item.argument + 1] - bounds[item.argument]);
+        }
+    }
+}
+
+#endif//_LOG_FORMAT_TABLE_H_
@@ -130,6 +130,16 @@ struct MMX<size, size, dummy>
     }
 };
 
+//! CRC64 of a string only known at run time, same result as `COMPILE_TIME_CRC64_STR_EX(str, prev_crc)`
+inline uint64_t crc64(const char *str, uint64_t prev_crc = UINT64_C(0xFFFFFFFFFFFFFFFF))
+{
+    for(; *str; ++str)
+    {
+        prev_crc = (prev_crc >> 8) ^ crc64_table[(prev_crc ^ *str) & 0xFF];
+    }
+
+    return prev_crc ^ UINT64_C(0xFFFFFFFFFFFFFFFF);
+}
 
 // CRC32 macro
 #define COMPILE_TIME_CRC32_STR(x) (MM<sizeof(x)-1>::crc32(x))
@@ -18,20 +18,224 @@
 #include <system_error>
 #include <queue>
 #include <condition_variable>
+#include <algorithm>
+#include <csignal>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include "date/date.h"
 #include "log_manager.h"
 #include "log_message.h"
 
+#ifndef _WIN32
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 using namespace std::chrono_literals;
 
 namespace LogXX
 {
 
-    manager::manager(boost::filesystem::path configFile) : m_config(configFile)
+    targetWorker::targetWorker(std::shared_ptr<logTarget> target)
+        : m_target(target)
+        , m_backlog(0)
+        , m_delivered(0)
+        , m_dropped(0)
+        , m_lag(0)
+        , m_running(false)
+    {
+        Start();
+    }
+
+    targetWorker::~targetWorker()
+    {
+        Stop();
+    }
+
+    size_t targetWorker::Post(std::shared_ptr<const messageBatch> batch, size_t capacity, overflowPolicy policy)
+    {
+        size_t dropped(0);
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            auto full([this, &batch, capacity]
+            {
+                return m_backlog != 0 && m_backlog + batch->size() > capacity;
+            });
+
+            if(policy == OVERFLOW_DROP_NEWEST && full())
+            {
+                m_dropped += batch->size();
+                return batch->size();
+            }
+
+            // The batch being delivered is already off m_batches but still counts towards m_backlog, it can't be
+            // dropped, wait for it below
+            while(policy == OVERFLOW_DROP_OLDEST && !m_batches.empty() && full())
+            {
+                dropped += m_batches.front()->size();
+                m_backlog -= m_batches.front()->size();
+                m_batches.pop_front();
+            }
+
+            // Whole batches are queued, so levels can't be picked out here, wait rather than lose anything important
+            m_roomAvailable.wait(lock, [&full]
+            {
+                return !full();
+            });
+
+            m_dropped += dropped;
+            m_backlog += batch->size();
+            m_batches.push_back(std::move(batch));
+        }
+
+        m_batchesWaiting.notify_one();
+        return dropped;
+    }
+
+    void targetWorker::Start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(m_thread.joinable())
+        {
+            return;
+        }
+
+        m_running = true;
+        m_thread = std::thread([this]
+        {
+            ThreadMain();
+        });
+    }
+
+    void targetWorker::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+
+        m_batchesWaiting.notify_one();
+
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    targetStats targetWorker::getStats() const
     {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return {m_target, true, m_backlog, m_delivered, m_dropped, m_lag};
+    }
+
+    void targetWorker::ThreadMain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while(m_running || !m_batches.empty())
+        {
+            if(m_batches.empty())
+            {
+                lock.unlock();
+                m_target->Idle();
+                lock.lock();
+
+                m_batchesWaiting.wait_for(lock, 100ms, [this]
+                {
+                    return !m_running || !m_batches.empty();
+                });
+
+                continue;
+            }
+
+            auto batch(std::move(m_batches.front()));
+            m_batches.pop_front();
+            lock.unlock();
+
+            m_target->LogMessages(*batch);
+            auto lag(std::chrono::system_clock::now() - batch->front()->getDate());
+            auto count(batch->size());
+            batch.reset(); // Let go of the messages before taking the lock
+
+            lock.lock();
+            m_backlog -= count;
+            m_delivered += count;
+            m_lag = lag;
+            m_roomAvailable.notify_one();
+        }
+
+        lock.unlock();
+        m_target->Flush();
+    }
+
+    manager::manager(boost::filesystem::path configFile, size_t queueCapacity)
+        : m_running(false)
+        , m_messages(queueCapacity)
+        , m_consumerState(CONSUMER_AWAKE)
+        , m_maxLatency(5ms)
+        , m_wakeLevel(LOG_ERR)
+        , m_delivered(0)
+        , m_lag(0)
+        , m_overflowPolicy(OVERFLOW_BLOCK)
+        , m_keepLevel(LOG_ERR)
+        , m_dropped(0)
+        , m_blocked(0)
+        , m_droppedReported(0)
+        , m_lastReport(std::chrono::steady_clock::now())
+        , m_reorderWindow(0)
+        , m_lastOrdered()
+        , m_orderViolations(0)
+        , m_config(new configuration(configFile))
+        , m_configEpoch(0)
+        , m_configFile(configFile)
+        , m_configVersion(0, 0)
+        , m_configPollInterval(1000ms)
+        , m_watching(false)
+    {
+        m_configReaders[0] = 0;
+        m_configReaders[1] = 0;
+
+        if(!m_configFile.empty())
+        {
+            m_configVersion = configVersion();
+        }
+    }
+
+    bool manager::useCycleCounter(bool enable)
+    {
+        if(!tscClock::enable(enable))
+        {
+            return false;
+        }
+
+        if(enable)
+        {
+            // Take the slow first calibration now rather than on the log thread
+            m_clock.calibrate();
+        }
+
+        return true;
+    }
+
+    std::pair<std::time_t, uintmax_t> manager::configVersion() const
+    {
+        // Modification times only have a resolution of a second, the size catches most edits within the same second
+        boost::system::error_code timeError, sizeError;
+        auto modified(boost::filesystem::last_write_time(m_configFile, timeError));
+        auto size(boost::filesystem::file_size(m_configFile, sizeError));
+
+        return {timeError ? 0 : modified, sizeError ? 0 : size};
+    }
+
+    manager::~manager()
+    {
+        delete m_config.load();
     }
 
     void manager::Run()
@@ -44,7 +248,7 @@ namespace LogXX
         }
 
         m_globalmanager = shared_from_this();
-
+        m_running = true;
 
         // Launch thread with lambda and shared pointer to ensure that we don't get deleted out from under ourselves
         auto pThis(shared_from_this());
@@ -54,78 +258,647 @@ namespace LogXX
         });
 
         m_logThread.swap(logThread);
+
+        // Shutdown() stopped them, batches would pile up with nobody to deliver them
+        for(const auto &worker : m_workers)
+        {
+            worker->Start();
+        }
+
+        if(!m_configFile.empty() && m_configPollInterval.count() != 0)
+        {
+            m_watching = true;
+            m_watchThread = std::thread([this]
+            {
+                WatchMain();
+            });
+        }
+
+        m_activeManager.store(this);
+        callsite::invalidate();
     }
 
-    std::queue<std::shared_ptr<message>> manager::getMessages()
+    void manager::WatchMain()
     {
-        std::lock_guard<std::recursive_mutex> lock(m_logMutex);
+        std::unique_lock<std::mutex> lock(m_watchMutex);
+
+        while(m_watching)
+        {
+            m_watchStop.wait_for(lock, m_configPollInterval, [this]
+            {
+                return !m_watching;
+            });
 
-        std::queue<std::shared_ptr<message>> messages;
-        messages.swap(m_messages);
+            if(!m_watching)
+            {
+                break;
+            }
+
+            auto version(configVersion());
+            bool changed;
+
+            {
+                // m_configVersion belongs to ReloadConfiguration(), which may be running on another thread
+                std::lock_guard<std::mutex> reload(m_reloadMutex);
+                changed = version != m_configVersion;
+            }
 
-        return messages;
+            if(changed)
+            {
+                lock.unlock();
+                ReloadConfiguration();
+                lock.lock();
+            }
+        }
     }
 
-    void manager::ThreadMain()
+    bool manager::ReloadConfiguration()
     {
-        while(m_globalmanager.lock())
+        static callsite reloadSite(__FILE__, __func__, FUNC_NAME, "manager", "LogXX", __LINE__, LOG_ERR, LINECRC);
+
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        auto version(configVersion());
+        std::unique_ptr<configuration> loaded;
+
+        try
+        {
+            loaded.reset(new configuration(m_configFile));
+        }
+        catch(const std::exception &e)
         {
-            std::mutex waitMutex;
-            std::unique_lock<std::mutex> lock(waitMutex);
+            // Keep the configuration we have, and don't try this version of the file again
+            m_configVersion = version;
+            message::create(reloadSite, LOG_ERR)->format("Configuration %1% not reloaded: %2%", m_configFile, e.what())->PostMessage();
+            return false;
+        }
+
+        m_configVersion = version;
+
+        // Publish, then wait for readers that may still be looking at the old rules before deleting them. A reader can
+        // pick up the epoch just before a flip and count itself in just after, so both epochs have to be drained once.
+        auto previous(m_config.exchange(loaded.release()));
+
+        for(int flip(0); flip < 2; ++flip)
+        {
+            auto epoch(m_configEpoch.fetch_add(1));
+
+            while(m_configReaders[epoch & 1].load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        delete previous;
+
+        // Every call site has to look its level up again
+        callsite::invalidate();
+        return true;
+    }
+
+    void manager::addConfiguredTargets()
+    {
+        auto epoch(m_configEpoch.load());
+        m_configReaders[epoch & 1].fetch_add(1);
+
+        auto backends(m_config.load()->getBackends());
+
+        m_configReaders[epoch & 1].fetch_sub(1);
+
+        for(const auto &backend : backends)
+        {
+            auto type(backend.second.get<std::string>("type", ""));
+
+            if(boost::algorithm::iequals(type, "file"))
+            {
+                addTarget(std::make_shared<logFile>(backend.second));
+            }
+            else if(boost::algorithm::iequals(type, "clog"))
+            {
+                addTarget(std::make_shared<logCLog>());
+            }
+        }
+    }
+
+    levels manager::configuredLevel(const std::shared_ptr<message> &msg, rateLimit &limit)
+    {
+        auto epoch(m_configEpoch.load());
+        m_configReaders[epoch & 1].fetch_add(1);
+
+        auto config(m_config.load());
+        levels level(config->getMessageLevel(msg));
+        limit = config->getRateLimit(msg);
 
-            m_messagesWaiting.wait(lock);
-            LogMessages();
+        m_configReaders[epoch & 1].fetch_sub(1);
+        return level;
+    }
+
+    void manager::getMessages()
+    {
+        std::shared_ptr<message> msg;
+
+        while(m_messages.pop(msg))
+        {
+            m_batch.push_back(std::move(msg));
         }
     }
 
-    void manager::LogMessages()
+    void manager::ThreadMain()
     {
-        std::queue<std::shared_ptr<message>> messages(getMessages());
+        unsigned emptyNaps(0);
 
-        while(!messages.empty())
+        while(m_running)
         {
-            auto msg(messages.front());
-            messages.pop();
+            bool logged(LogMessages());
 
             for(auto manager : m_managers)
             {
-                manager->LogMessage(msg);
+                manager->Idle();
             }
+
+            if(logged)
+            {
+                emptyNaps = 0;
+                continue;
+            }
+
+            // Messages tend to come in bursts, look again a few times before paying for a sleep and a wake up
+            bool waiting(false);
+
+            for(unsigned spin(0); spin < spinCount && !waiting; ++spin)
+            {
+                std::this_thread::yield();
+                waiting = m_messages.size() != 0;
+            }
+
+            if(waiting)
+            {
+                continue;
+            }
+
+            // Nap while logging is busy, so producers don't have to wake us, sleep once it has gone quiet. Messages held
+            // for reordering are due soon, keep napping until they have gone.
+            auto state(m_reorder.empty() && ++emptyNaps * m_maxLatency >= idleWakeup ? CONSUMER_SLEEPING : CONSUMER_NAPPING);
+
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_consumerState.store(state);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            m_messagesWaiting.wait_for(lock, state == CONSUMER_SLEEPING ? std::chrono::microseconds(idleWakeup) : m_maxLatency, [this]
+            {
+                return !m_running || m_consumerState.load() == CONSUMER_AWAKE || m_messages.size() != 0;
+            });
+
+            m_consumerState.store(CONSUMER_AWAKE);
         }
+    }
 
+    void manager::wakeConsumer(bool urgent)
+    {
+        // Pairs with the fence in ThreadMain, either we see it going to sleep or it sees our message
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto state(m_consumerState.load(std::memory_order_relaxed));
+
+        if(state == CONSUMER_SLEEPING || (state == CONSUMER_NAPPING && urgent))
+        {
+            // Only the first producer to get here pays for the notify
+            if(m_consumerState.exchange(CONSUMER_AWAKE) != CONSUMER_AWAKE)
+            {
+                std::lock_guard<std::mutex> lock(m_waitMutex);
+                m_messagesWaiting.notify_one();
+            }
+        }
+    }
+
+    void manager::reportDropped(bool force)
+    {
+        static callsite dropSite(__FILE__, __func__, FUNC_NAME, "manager", "LogXX", __LINE__, LOG_WARNING, LINECRC);
+
+        auto now(std::chrono::steady_clock::now());
+        uint64_t dropped(m_dropped.load());
+
+        if(dropped == m_droppedReported || (!force && now - m_lastReport < dropReportInterval))
+        {
+            return;
+        }
+
+        // Straight into the batch, going through the queue would only get it dropped as well
+        auto msg(message::create(dropSite, LOG_WARNING));
+        msg->format("%1% messages dropped, the log queue was full", dropped - m_droppedReported);
+        m_batch.push_back(msg);
+
+        m_droppedReported = dropped;
+        m_lastReport = now;
+    }
+
+    void manager::reportSuppressed(bool force)
+    {
+        for(auto site(callsite::takeSuppressedList()); site; site = site->nextSuppressed())
+        {
+            m_suppressing.emplace_back(site, coarseClock::now());
+        }
+
+        auto now(coarseClock::now());
+        auto interval(std::chrono::duration_cast<std::chrono::nanoseconds>(suppressReportInterval).count());
+
+        for(auto entry(m_suppressing.begin()); entry != m_suppressing.end();)
+        {
+            const auto &site(*entry->first);
+
+            // The window closes once the call site has gone quiet long enough to refill its rate limit, while it is
+            // still flooding summarise now and then
+            bool closed(force || site.refilled(now));
+
+            if(!closed && now - entry->second < interval)
+            {
+                ++entry;
+                continue;
+            }
+
+            uint64_t suppressed(site.takeSuppressed(closed));
+            levels level;
+
+            // Unless a reload has turned the call site off since
+            if(suppressed != 0 && (!site.resolved(level) || site.getLevel() <= level))
+            {
+                auto msg(message::create(site, site.getLevel()));
+                msg->format("suppressed %1% similar messages", suppressed);
+                m_batch.push_back(msg);
+            }
+
+            if(closed)
+            {
+                entry = m_suppressing.erase(entry);
+            }
+            else
+            {
+                entry->second = now;
+                ++entry;
+            }
+        }
+    }
+
+    bool manager::LogMessages(bool final)
+    {
+        getMessages();
+        reportDropped(final);
+        reportSuppressed(final);
+
+        if(m_batch.empty() && m_reorder.empty())
+        {
+            return false;
+        }
+
+        bool received(!m_batch.empty());
+        bool calibrated(false);
+
+        for(const auto &msg : m_batch)
+        {
+            if(msg->getTicks() != 0)
+            {
+                if(!calibrated)
+                {
+                    m_clock.calibrate();
+                    calibrated = true;
+                }
+
+                msg->set_date(m_clock.toSystem(msg->getTicks()));
+            }
+
+            msg->formatDeferred();
+        }
+
+#ifndef _WIN32
+        if(m_ring)
+        {
+            m_ring->LogMessages(m_batch);
+        }
+#endif
+
+        if(m_reorderWindow.count() != 0)
+        {
+            reorder(final);
+        }
+
+        if(m_batch.empty())
+        {
+            return received;
+        }
+
+        // Back ends with their own thread share a copy, so they can start on it while the rest run here
+        if(!m_workers.empty())
+        {
+            auto shared(std::make_shared<const messageBatch>(m_batch));
+
+            for(const auto &worker : m_workers)
+            {
+                worker->Post(shared, m_messages.capacity(), m_overflowPolicy);
+            }
+        }
+
+        for(auto manager : m_managers)
+        {
+            manager->LogMessages(m_batch);
+        }
+
+        m_delivered += m_batch.size();
+        m_lag = (std::chrono::system_clock::now() - m_batch.front()->getDate()).count();
+
+        // Release the messages back to the pool, but keep the capacity
+        m_batch.clear();
+        return true;
+    }
+
+    void manager::reorder(bool final)
+    {
+        // Oldest on top, ties between messages stamped at the same time go by sequence
+        auto later([](const std::shared_ptr<message> &a, const std::shared_ptr<message> &b)
+        {
+            return std::make_pair(a->getDate(), a->getSequence()) > std::make_pair(b->getDate(), b->getSequence());
+        });
+
+        for(auto &msg : m_batch)
+        {
+            m_reorder.push_back(std::move(msg));
+            std::push_heap(m_reorder.begin(), m_reorder.end(), later);
+        }
+
+        m_batch.clear();
+
+        // Never hold more than the queue does, messages come from a bounded pool
+        auto due(std::chrono::system_clock::now() - m_reorderWindow);
+
+        while(!m_reorder.empty() && (final || m_reorder.front()->getDate() <= due || m_reorder.size() > m_messages.capacity()))
+        {
+            std::pop_heap(m_reorder.begin(), m_reorder.end(), later);
+
+            auto &msg(m_reorder.back());
+            auto key(std::make_pair(msg->getDate(), msg->getSequence()));
+
+            if(key < m_lastOrdered)
+            {
+                ++m_orderViolations;
+            }
+            else
+            {
+                m_lastOrdered = key;
+            }
+
+            m_batch.push_back(std::move(msg));
+            m_reorder.pop_back();
+        }
     }
 
     void manager::Shutdown()
     {
+        std::lock_guard<std::recursive_mutex> lock(m_logMutex);
+
         if(m_globalmanager.lock())
         {
+            // Stop accepting messages and wait for producers that already hold a pointer to us
+            callsite::disable();
+            m_activeManager.store(nullptr);
+
+            // A counter seen at zero stays clear of us, anyone counted on it later loads the null pointer
+            for(auto &producers : m_activeProducers)
+            {
+                while(producers.count.load() != 0)
+                {
+                    wakeConsumer(true);
+                    std::this_thread::yield();
+                }
+            }
+
             m_globalmanager.reset();
+
+            if(m_watchThread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> watchLock(m_watchMutex);
+                    m_watching = false;
+                }
+
+                m_watchStop.notify_all();
+                m_watchThread.join();
+            }
+
+            {
+                std::lock_guard<std::mutex> waitLock(m_waitMutex);
+                m_running = false;
+            }
+
             m_messagesWaiting.notify_all();
             m_logThread.join();
-            LogMessages(); // Dump any remaining messages
+            LogMessages(true); // Dump any remaining messages
+
+            for(auto manager : m_managers)
+            {
+                manager->Flush();
+            }
+
+            for(const auto &worker : m_workers)
+            {
+                worker->Stop();
+            }
+        }
+    }
+
+    std::vector<targetStats> manager::getTargetStats() const
+    {
+        std::vector<targetStats> stats;
+
+        for(const auto &target : m_managers)
+        {
+            stats.push_back({target, false, m_messages.size(), m_delivered.load(), 0,
+                             std::chrono::system_clock::duration(m_lag.load())});
         }
+
+        for(const auto &worker : m_workers)
+        {
+            stats.push_back(worker->getStats());
+        }
+
+        return stats;
     }
 
     void manager::pushMessage(std::shared_ptr<message> msg)
     {
-        std::lock_guard<std::recursive_mutex> lock(m_logMutex);
-        m_messages.push(msg);
-        m_messagesWaiting.notify_one();
+        bool urgent(msg->getLevel() <= m_wakeLevel);
 
+        if(!m_messages.push(std::move(msg)))
+        {
+            auto policy(m_overflowPolicy);
+
+            if(policy == OVERFLOW_DROP_BELOW_LEVEL)
+            {
+                policy = msg->getLevel() <= m_keepLevel ? OVERFLOW_BLOCK : OVERFLOW_DROP_NEWEST;
+            }
+
+            switch(policy)
+            {
+                case OVERFLOW_DROP_NEWEST:
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+
+                case OVERFLOW_DROP_OLDEST:
+                {
+                    std::shared_ptr<message> oldest;
+
+                    do
+                    {
+                        if(m_messages.pop(oldest))
+                        {
+                            m_dropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                    while(!m_messages.push(std::move(msg)));
+
+                    break;
+                }
+
+                default:
+                    // Wait for the log thread to catch up
+                    m_blocked.fetch_add(1, std::memory_order_relaxed);
+
+                    do
+                    {
+                        wakeConsumer(true);
+                        std::this_thread::yield();
+                    }
+                    while(!m_messages.push(std::move(msg)));
+
+                    break;
+            }
+        }
+
+        // Once the queue is half full waiting out the nap risks blocking or dropping, treat it as urgent
+        wakeConsumer(urgent || m_messages.size() > m_messages.capacity() / 2);
+    }
+
+    bool manager::filterMessage(std::shared_ptr<message> &msg)
+    {
+        const auto &site(msg->getCallsite());
+        levels level;
+
+        if(!site.resolved(level))
+        {
+            // Slow path, taken once per call site and configuration generation
+            uint32_t generation(callsite::generation());
+            rateLimit limit;
+            level = configuredLevel(msg, limit);
+            site.limit(limit.rate, limit.burst);
+#ifndef _WIN32
+            site.resolve(level, m_ring ? LOG_ALL : level, generation);
+#else
+            site.resolve(level, level, generation);
+#endif
+        }
+
+        if(msg->getLevel() <= level)
+        {
+            // Lent for the ring when the call site was last resolved, the queue needs a message of its own
+            if(msg->isCaptureSlot())
+            {
+                msg = msg->detach();
+            }
+
+            return true;
+        }
+
+#ifndef _WIN32
+        if(m_ring)
+        {
+            // Only the ring keeps it, so it goes straight there rather than through the queue and the log thread
+            msg->formatDeferred();
+
+            if(msg->getTicks() != 0)
+            {
+                msg->set_date(std::chrono::system_clock::now());
+            }
+
+            m_ring->LogMessage(msg);
+        }
+#endif
+
+        return false;
+    }
+
+    std::atomic<uint32_t> &manager::producerCounter()
+    {
+        static std::atomic<size_t> nextShard(0);
+        thread_local std::atomic<uint32_t> &counter(m_activeProducers[nextShard.fetch_add(1, std::memory_order_relaxed) % producerShards].count);
+
+        return counter;
     }
 
     void manager::logMessage(std::shared_ptr<message> msg)
     {
-        std::lock_guard<std::recursive_mutex> lock(m_logMutex);
-        auto managerPtr(m_globalmanager.lock());
+        // Sequentially consistent so Shutdown can never miss a producer that saw a live manager
+        auto &producers(producerCounter());
+        producers.fetch_add(1);
+        auto managerPtr(m_activeManager.load());
+
+        if(managerPtr && managerPtr->filterMessage(msg))
+        {
+            managerPtr->pushMessage(std::move(msg));
+        }
+
+        producers.fetch_sub(1);
+    }
+
+#ifndef _WIN32
+    void manager::DumpRing(logTarget &target)
+    {
+        if(m_ring)
+        {
+            m_ring->Dump(target);
+        }
+    }
+
+    void manager::DumpRing(int fd)
+    {
+        auto managerPtr(m_activeManager.load());
+
+        if(managerPtr && managerPtr->m_ring)
+        {
+            managerPtr->m_ring->Dump(fd);
+        }
+    }
+
+    namespace
+    {
+        void crashHandler(int signal)
+        {
+            manager::DumpRing(STDERR_FILENO);
+
+            // The handler was reset on entry, so this ends the process the way the signal would have
+            std::raise(signal);
+        }
+    }
+
+    void manager::InstallCrashHandler()
+    {
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = crashHandler;
+        action.sa_flags = SA_RESETHAND | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
 
-        if(managerPtr)
+        for(int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
         {
-            managerPtr->pushMessage(msg);
+            sigaction(signal, &action, nullptr);
         }
     }
+#endif
 
     std::weak_ptr<manager> manager::m_globalmanager;
     std::recursive_mutex  manager::m_logMutex;
+    std::atomic<manager *> manager::m_activeManager(nullptr);
+    manager::producerCount manager::m_activeProducers[manager::producerShards];
+    constexpr std::chrono::seconds manager::dropReportInterval;
+    constexpr std::chrono::seconds manager::suppressReportInterval;
+    constexpr std::chrono::milliseconds manager::idleWakeup;
+    constexpr unsigned manager::spinCount;
+    constexpr size_t manager::producerShards;
+    constexpr size_t manager::cacheLine;
 
 }
@@ -17,6 +17,13 @@
 #include <mutex>
 #include <system_error>
 #include <queue>
+#include <deque>
+#include <vector>
+#include <list>
+#include <utility>
+#include <ctime>
+#include <thread>
+#include <atomic>
 #include <condition_variable>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
@@ -24,39 +31,290 @@
 #include "date/date.h"
 #include "log_target.h"
 #include "log_config.h"
+#include "log_queue.h"
 
 namespace LogXX
 {
+    //! Messages drained from the manager queue in one go, oldest first
+    using messageBatch = std::vector<std::shared_ptr<message>>;
+
+    //! What producers do when the manager queue is full, see manager::setOverflowPolicy()
+    enum overflowPolicy
+    {
+        OVERFLOW_BLOCK,             //!< wait for the log thread to make room, nothing is lost
+        OVERFLOW_DROP_NEWEST,       //!< throw away the message being logged
+        OVERFLOW_DROP_OLDEST,       //!< throw away the oldest queued message to make room
+        OVERFLOW_DROP_BELOW_LEVEL   //!< wait for messages at or above the keep level, throw away the rest
+    };
+
+    //! How well a log back end is keeping up, see manager::getTargetStats()
+    struct targetStats
+    {
+        std::shared_ptr<logTarget>          target;
+        bool                                ownThread;  //!< runs on its own thread rather than the log thread
+        size_t                              backlog;    //!< messages waiting to be handed to the back end
+        uint64_t                            delivered;  //!< messages handed to the back end so far
+        uint64_t                            dropped;    //!< messages this back end never saw because it fell behind
+        std::chrono::system_clock::duration lag;        //!< age of the oldest message in the last batch, when it was handed over
+    };
+
+    //! Runs a log back end on its own thread
+    //! \details The log thread shares each batch with every worker, each worker works through its own queue of batches at
+    //!          its own pace, so a slow back end only holds up itself.
+    class targetWorker
+    {
+        public:
+            explicit targetWorker(std::shared_ptr<logTarget> target);
+            ~targetWorker();
+
+            targetWorker(const targetWorker &) = delete;
+            targetWorker &operator=(const targetWorker &) = delete;
+
+            //! Queue a batch for the back end
+            //! \param[in] batch messages to log
+            //! \param[in] capacity most messages the back end may have waiting
+            //! \param[in] policy what to do when the back end has `capacity` messages waiting, anything other than
+            //!            dropping wait for room, a batch is never split
+            //! \return number of messages dropped
+            size_t Post(std::shared_ptr<const messageBatch> batch, size_t capacity, overflowPolicy policy);
+
+            void Start();                                               //!< Start the thread, if it isn't running already
+            void Stop();                                                //!< Finish queued batches, flush the back end and end the thread
+            targetStats getStats() const;                               //!< Snapshot of backlog and lag
+
+        private:
+            void ThreadMain();
+
+            std::shared_ptr<logTarget> m_target;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_batchesWaiting;
+            std::condition_variable m_roomAvailable;
+            std::deque<std::shared_ptr<const messageBatch>> m_batches;
+            size_t m_backlog;
+            uint64_t m_delivered;
+            uint64_t m_dropped;
+            std::chrono::system_clock::duration m_lag;
+            bool m_running;
+            std::thread m_thread;
+    };
+
     //! Main thread manager
     class manager : public std::enable_shared_from_this<manager>
     {
         public:
-            manager(boost::filesystem::path configFile = boost::filesystem::path());
+            //! \param[in] configFile optional xml or json configuration file
+            //! \param[in] queueCapacity number of messages that may be waiting for the log thread before producers stall
+            manager(boost::filesystem::path configFile = boost::filesystem::path(), size_t queueCapacity = 8192);
+            ~manager();
 
             void Run();                                                 //!< Start log manager thread
             void Shutdown();                                            //!< End log manager thread
             static void logMessage(std::shared_ptr<message> msg);       //!< Enque a single log message, if manager is running
 
             //! Add a log back end
-            inline void addTarget(std::shared_ptr<logTarget> target)
+            //! \param[in] target log back end
+            //! \param[in] ownThread run the back end on a thread of its own, so it can't hold up the others
+            //! \note Back ends on their own thread see messages while other threads may read them too, they must only use
+            //!       the const members of message
+            inline void addTarget(std::shared_ptr<logTarget> target, bool ownThread = false)
+            {
+                if(ownThread)
+                {
+                    m_workers.push_back(std::make_unique<targetWorker>(target));
+                }
+                else
+                {
+                    m_managers.push_back(target);
+                }
+            }
+
+            //! Add the log back ends described by `backend` nodes in the configuration, call before Run()
+            //! \details Nodes with `type` "file" become a logFile, see logFile::logFile(const boost::property_tree::ptree &),
+            //!          and "clog" a logCLog. Other types are left for the application to set up.
+            //! \throw std::invalid_argument if a file back end can't be read
+            void addConfiguredTargets();
+
+            //! Backlog and lag of every log back end
+            std::vector<targetStats> getTargetStats() const;
+
+            //! Choose what happens when producers outrun the log thread, call before Run()
+            //! \param[in] policy what producers do when the queue is full
+            //! \param[in] keepLevel with OVERFLOW_DROP_BELOW_LEVEL, messages at this level or more severe are never dropped
+            //! \note The queue holds at most `queueCapacity` messages, see the constructor, back ends with their own thread
+            //!       hold at most the same number each. Messages come from a pool and keep their arguments inline, so
+            //!       the memory held is bounded by the capacities.
+            inline void setOverflowPolicy(overflowPolicy policy, levels keepLevel = LOG_ERR)
+            {
+                m_overflowPolicy = policy;
+                m_keepLevel = keepLevel;
+            }
+
+            //! Bound how long a message may wait in the queue, call before Run()
+            //! \param[in] maxLatency the log thread checks the queue at least this often while messages are arriving
+            //! \param[in] wakeLevel messages at this level or more severe wake the log thread straight away
+            //! \note Producers only wake the log thread when it is fast asleep, or for messages at `wakeLevel`, everything
+            //!       else is picked up within `maxLatency`. That saves a system call per message at the cost of a timer
+            //!       on the log thread while logging is busy.
+            inline void setMaxLatency(std::chrono::microseconds maxLatency, levels wakeLevel = LOG_ERR)
             {
-                m_managers.push_back(target);
+                m_maxLatency = maxLatency;
+                m_wakeLevel = wakeLevel;
             }
 
+            //! Hold messages back for up to `window` so back ends get them in time stamp order, call before Run(), zero
+            //! turns ordering off
+            //! \details Messages are stamped with a global sequence number as well as the time. They can reach the queue out
+            //!          of order, a producer can be preempted between stamping a message and queueing it, so the log thread
+            //!          keeps the newest `window` of messages in a heap keyed on time and sequence and hands them on oldest
+            //!          first. Producers only pay for an atomic increment.
+            //! \note A message that arrives after a later one has been handed on is delivered anyway, and counted, see
+            //!       getOrderViolations(). Messages are delivered up to `window` plus setMaxLatency() after being logged.
+            //!       Ordering is not guaranteed once the queue is full: producers waiting for room hold on to messages
+            //!       they have already stamped, and the heap never holds more than the queue, so it hands messages on
+            //!       before their window is up.
+            inline void setReorderWindow(std::chrono::microseconds window)
+            {
+                m_reorderWindow = window;
+                message::useSequence(window.count() != 0);
+            }
+
+            //! Messages handed on after a later one, because they reached the log thread outside the reorder window
+            uint64_t getOrderViolations() const { return m_orderViolations.load(); }
+
+            //! How often the configuration file is checked for changes, call before Run(), zero stops checking
+            inline void setConfigPollInterval(std::chrono::milliseconds interval)
+            {
+                m_configPollInterval = interval;
+            }
+
+            //! Stamp messages with the CPU cycle counter instead of the system clock
+            //! \details Reading the system clock is most of the cost of creating a message on some systems, the cycle
+            //!          counter is a single instruction. The log thread converts the counts to wall clock time before
+            //!          anything else sees the message, recalibrating against the system clock about once a second.
+            //! \return false if this CPU has no invariant cycle counter, messages keep using the system clock
+            //! \note Applies to every message, whichever manager logs it. Call before Run().
+            bool useCycleCounter(bool enable);
+
+            //! Read the configuration file again and switch to it
+            //! \details The new rules are compiled on the calling thread, then swapped in, producers never wait for a
+            //!          reload. Every call site looks its level up again afterwards.
+            //! \return false if the file couldn't be read, the current configuration is kept
+            bool ReloadConfiguration();
+
+            uint64_t getDropped() const { return m_dropped.load(); }    //!< Messages dropped because the queue was full
+            uint64_t getBlocked() const { return m_blocked.load(); }    //!< Messages whose producer had to wait for room
+
+#ifndef _WIN32
+            //! Keep a crash ring, call before Run()
+            //! \note While a ring is set every message is captured, including the ones the configuration filters out. Those
+            //!       are formatted and written to the ring by the thread logging them, they never take a place in the queue,
+            //!       but call sites can no longer skip formatting filtered messages, so this isn't free. They can land in the
+            //!       ring ahead of queued messages logged just before them.
+            inline void setRing(std::shared_ptr<logRing> ring)
+            {
+                m_ring = ring;
+            }
+
+            //! Replay the crash ring into a log back end, e.g. after an error to see what led up to it
+            void DumpRing(logTarget &target);
+
+            //! Write the crash ring text to a file descriptor, async signal safe
+            static void DumpRing(int fd);
+
+            //! Dump the crash ring to stderr when the process dies from SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT
+            static void InstallCrashHandler();
+#endif
+
         private:
-            std::queue<std::shared_ptr<message>> getMessages();     //!< Get messages to be logged
+            void getMessages();                                     //!< Move queued messages into m_batch
             void pushMessage(std::shared_ptr<message> msg);         //!< Enqueue a single log message
+            bool filterMessage(std::shared_ptr<message> &msg);      //!< Check message against the configuration, capture only messages go to the ring here
             void ThreadMain();                                      //!< Main thread for logging
-            void LogMessages();                                     //!< Send all currently queued messages to backends
+            bool LogMessages(bool final = false);                   //!< Send all currently queued messages to backends, false if there were none
+            void wakeConsumer(bool urgent);                         //!< Wake the log thread if it is asleep for longer than we can wait
+            void WatchMain();                                       //!< Configuration file watcher thread
+            std::pair<std::time_t, uintmax_t> configVersion() const;   //!< Modification time and size of the configuration file
+            levels configuredLevel(const std::shared_ptr<message> &msg, rateLimit &limit); //!< Level and rate limit from the current configuration, lock free
+            void reportDropped(bool force);                         //!< Add a "messages dropped" record to m_batch when due
+            void reportSuppressed(bool force);                      //!< Add "similar messages suppressed" records to m_batch when due
+            void reorder(bool final);                               //!< Pass m_batch through the reorder heap, leaving the messages that are due
+
+            static constexpr std::chrono::seconds dropReportInterval{1}; //!< Shortest time between "messages dropped" records
+            static constexpr std::chrono::seconds suppressReportInterval{1}; //!< Shortest time between summaries for a call site that is still over its rate limit
+            static constexpr std::chrono::milliseconds idleWakeup{100};  //!< Longest the log thread sleeps, so targets get Idle()
+            static constexpr unsigned spinCount = 64;                    //!< Times the log thread checks the queue before it sleeps
+            static constexpr size_t producerShards = 64;                 //!< Counters m_activeProducers is split over
+            static constexpr size_t cacheLine = 64;
+
+            //! What the log thread is doing, tells producers whether they need to wake it
+            enum consumerState
+            {
+                CONSUMER_AWAKE,     //!< working, or about to look at the queue
+                CONSUMER_NAPPING,   //!< back within m_maxLatency, only urgent messages need a wake up
+                CONSUMER_SLEEPING   //!< nothing logged for a while, any message needs a wake up
+            };
 
             static std::weak_ptr<manager> m_globalmanager;
             static std::recursive_mutex  m_logMutex;
+            //! Producers currently holding m_activeManager on the threads that share this counter, on a cache line of its own
+            struct producerCount
+            {
+                std::atomic<uint32_t>   count;
+                char                    pad[cacheLine - sizeof(std::atomic<uint32_t>)];
+            };
+
+            //! Counter for the calling thread, threads are spread over the counters as they first log
+            static std::atomic<uint32_t> &producerCounter();
+
+            static std::atomic<manager *> m_activeManager;          //!< Lock free handle used by producers
+            static producerCount          m_activeProducers[producerShards];
 
             std::thread m_logThread;
-            std::queue<std::shared_ptr<message>> m_messages;
+            std::atomic<bool> m_running;
+            boundedQueue<std::shared_ptr<message>> m_messages;
+            std::vector<std::shared_ptr<message>> m_batch;          //!< Messages being dispatched, reused to avoid allocations
+            std::mutex m_waitMutex;                                 //!< Guards the log thread going to sleep
             std::condition_variable m_messagesWaiting;
+            std::atomic<consumerState> m_consumerState;
+            std::chrono::microseconds m_maxLatency;
+            levels m_wakeLevel;
             std::list<std::shared_ptr<logTarget>> m_managers;
+            std::list<std::unique_ptr<targetWorker>> m_workers;     //!< Back ends with a thread of their own
+            std::atomic<uint64_t> m_delivered;                      //!< Messages handed to m_managers
+            std::atomic<int64_t> m_lag;                             //!< m_managers lag, in system_clock ticks
+            tscClock m_clock;                                       //!< Converts cycle counter stamps, log thread only once running
+
+            overflowPolicy m_overflowPolicy;
+            levels m_keepLevel;
+            std::atomic<uint64_t> m_dropped;
+            std::atomic<uint64_t> m_blocked;
+            uint64_t m_droppedReported;                             //!< m_dropped as of the last report
+            std::chrono::steady_clock::time_point m_lastReport;
+            std::vector<std::pair<const callsite *, int64_t>> m_suppressing; //!< Rate limited call sites and when their last summary was, log thread only
+
+            std::chrono::system_clock::duration m_reorderWindow;
+            std::vector<std::shared_ptr<message>> m_reorder;        //!< Messages held back, a heap with the oldest on top
+            std::pair<std::chrono::system_clock::time_point, uint64_t> m_lastOrdered;  //!< Time and sequence of the last message handed on
+            std::atomic<uint64_t> m_orderViolations;
+#ifndef _WIN32
+            std::shared_ptr<logRing> m_ring;
+#endif
+
+            //! Current configuration, replaced RCU style by ReloadConfiguration()
+            //! \details Readers count themselves in under the current epoch before loading the pointer. A reload swaps the
+            //!          pointer, moves new readers on to the other epoch and waits for the old epoch to empty before
+            //!          deleting the configuration it replaced.
+            std::atomic<configuration *> m_config;
+            std::atomic<uint32_t> m_configEpoch;
+            std::atomic<uint32_t> m_configReaders[2];
+            std::mutex m_reloadMutex;                               //!< One reload at a time
 
-            configuration m_config;
+            boost::filesystem::path m_configFile;
+            std::pair<std::time_t, uintmax_t> m_configVersion;      //!< Modification time and size of the configuration in use
+            std::chrono::milliseconds m_configPollInterval;
+            std::thread m_watchThread;
+            std::mutex m_watchMutex;
+            std::condition_variable m_watchStop;
+            bool m_watching;
     };
 }
@@ -11,7 +11,9 @@
 #include <map>
 #include <chrono>
 #include <string>
+#include <sstream>
 #include <algorithm>
+#include <cmath>
 #include <boost/algorithm/string.hpp>
 #include "log_manager.h"
 #include "log_message.h"
@@ -34,6 +36,171 @@ namespace LogXX
         {LOG_ALL,       "ALL"}
     };
 
+    std::atomic<uint32_t> callsite::m_generation(0);
+    std::atomic<uint32_t> callsite::m_lastGeneration(0);
+    std::atomic<const callsite *> callsite::m_suppressedList(nullptr);
+    std::atomic<bool> message::m_sequencing(false);
+    std::atomic<uint64_t> message::m_nextSequence(0);
+
+    void callsite::invalidate()
+    {
+        // Generations are stored above the level bits, skip 0 as it means "disabled"
+        uint32_t generation;
+
+        do
+        {
+            generation = (m_lastGeneration.fetch_add(1, std::memory_order_relaxed) + 1) & (UINT32_MAX >> generationShift);
+        }
+        while(generation == 0);
+
+        m_generation.store(generation, std::memory_order_relaxed);
+    }
+
+    void callsite::limit(double rate, double burst) const
+    {
+        if(rate <= 0)
+        {
+            m_interval.store(0, std::memory_order_relaxed);
+            return;
+        }
+
+        auto interval(std::max<int64_t>(std::llround(1e9 / rate), 1));
+
+        m_tolerance.store(static_cast<int64_t>((std::max(burst, 1.0) - 1) * interval), std::memory_order_relaxed);
+        m_interval.store(interval, std::memory_order_relaxed);
+    }
+
+    void callsite::suppress() const
+    {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+
+        // Only the message that finds the call site off the list pushes it
+        if(m_listed.load(std::memory_order_relaxed) || m_listed.exchange(true))
+        {
+            return;
+        }
+
+        auto head(m_suppressedList.load(std::memory_order_relaxed));
+
+        do
+        {
+            m_nextSuppressed = head;
+        }
+        while(!m_suppressedList.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    const callsite &callsite::unknown()
+    {
+        static const callsite site;
+        return site;
+    }
+
+    constexpr const char *message::defaultHeaderFormat;
+
+    //! Messages the log thread is done with, waiting to be reused
+    //! \note Never destroyed, messages may be released from static destructors after main() has exited
+    static boundedQueue<message *> &messageFreeList()
+    {
+        static auto *messages(new boundedQueue<message *>(4096));
+        return *messages;
+    }
+
+    struct message::recycler
+    {
+        void operator()(message *msg) const
+        {
+            msg->releaseArguments();
+
+            if(!messageFreeList().push(std::move(msg)))
+            {
+                delete msg;
+            }
+        }
+    };
+
+    struct message::captureRelease
+    {
+        bool *busy;
+
+        void operator()(message *msg) const
+        {
+            msg->releaseArguments();
+            *busy = false;
+        }
+    };
+
+    std::shared_ptr<message> message::create(const callsite &site, levels level)
+    {
+        // Messages below the configured level only go to the crash ring, which takes them before PostMessage() returns
+        if(site.captureOnly(level))
+        {
+            struct captureSlot
+            {
+                message msg;
+                bool    busy = false;
+            };
+
+            thread_local captureSlot slot;
+
+            // Unless formatting an argument logs another message, that one comes from the pool
+            if(!slot.busy)
+            {
+                slot.busy = true;
+                slot.msg.reset(site, level);
+                slot.msg.m_captureSlot = true;
+                return std::shared_ptr<message>(&slot.msg, captureRelease{&slot.busy}, poolAllocator<message>());
+            }
+        }
+
+        return pooled(site, level);
+    }
+
+    std::shared_ptr<message> message::pooled(const callsite &site, levels level)
+    {
+        message *msg;
+
+        if(messageFreeList().pop(msg))
+        {
+            msg->reset(site, level);
+        }
+        else
+        {
+            msg = new message(site, level);
+        }
+
+        // The control block comes from a pool as well, so a steady stream of messages never touches the heap
+        return std::shared_ptr<message>(msg, recycler(), poolAllocator<message>());
+    }
+
+    void message::reset(const callsite &site, levels level)
+    {
+        m_callsite = &site;
+        m_level = level;
+        m_ticks = tscClock::enabled() ? tscClock::ticks() : 0;
+        m_logTime = m_ticks ? std::chrono::system_clock::time_point() : std::chrono::system_clock::now();
+        m_sequence = nextSequence();
+        m_threadID = std::this_thread::get_id();
+        m_captureSlot = false;
+    }
+
+    std::shared_ptr<message> message::detach()
+    {
+        formatDeferred();
+
+        auto copy(pooled(*m_callsite, m_level));
+        auto *msg(copy.get());
+
+        msg->m_ticks = m_ticks;
+        msg->m_logTime = m_logTime;
+        msg->m_sequence = m_sequence;
+        msg->m_threadID = m_threadID;
+        msg->m_formatString = m_formatString;
+        msg->m_format = m_format;
+        msg->m_textBody = m_textBody;
+
+        return copy;
+    }
+
     //! Helper to convert text to level
     levels message::stringToLevel(const std::string &levelStr)
     {
@@ -69,27 +236,149 @@ namespace LogXX
 
     message *message::PostMessage()
     {
-        // Format the default message header
-        getMessageHeaderConst(m_defaultFormatString);
-        
         manager::logMessage(shared_from_this());
 
         return this;
     }
 
+    messageStream::buffer::buffer()
+        : appender(text)
+        , stream(&appender)
+        , busy(false)
+    {
+        text.reserve(256);
+    }
+
+    void messageStream::start(const callsite &site, levels level)
+    {
+        thread_local buffer threadBuffer;
+
+        if(threadBuffer.busy)
+        {
+            // Streaming a value logged another message
+            m_nested = std::make_unique<buffer>();
+            m_buffer = m_nested.get();
+        }
+        else
+        {
+            m_buffer = &threadBuffer;
+        }
+
+        // Whatever the last message did to the stream state doesn't carry over
+        m_buffer->busy = true;
+        m_buffer->text.clear();
+        m_buffer->stream.clear();
+        m_buffer->stream.flags(std::ios_base::skipws | std::ios_base::dec);
+        m_buffer->stream.precision(6);
+        m_buffer->stream.width(0);
+        m_buffer->stream.fill(' ');
+
+        m_message = message::create(site, level);
+    }
+
+    void messageStream::post()
+    {
+        m_message->set_text(m_buffer->text);
+        m_message->PostMessage();
+        m_message.reset();
+    }
+
+    void message::formatDeferred()
+    {
+        if(m_arguments)
+        {
+            try
+            {
+                m_format.parse(m_formatString);
+                m_format.clear();
+                m_arguments->apply(m_format);
+            }
+            catch(const std::exception &e)
+            {
+                // There is nobody to throw to on the log thread, log the problem instead, a format error or whatever a
+                // print() overload threw
+                m_format = boost::format("%1% \"%2%\"") % e.what() % m_formatString;
+            }
+            catch(...)
+            {
+                m_format = boost::format("unknown exception formatting \"%1%\"") % m_formatString;
+            }
+
+            releaseArguments();
+        }
+    }
+
+    message *message::set_text(const std::string &text)
+    {
+        releaseArguments();
+
+        m_formatString.assign(text);
+        m_textBody = true;
+        return this;
+    }
+
     std::string message::getMessage() const
     {
-        std::stringstream s;
-        s << m_format;
-        return s.str();
+        return getMessageBody().str();
+    }
+
+    namespace
+    {
+        //! Date and time text of the last second a thread formatted a header for
+        struct timestampCache
+        {
+            std::chrono::system_clock::time_point   second = std::chrono::system_clock::time_point::min();
+            std::string                             date;
+            std::string                             time;
+            size_t                                  fraction = std::string::npos;  //!< Offset of the sub-second digits in `time`
+        };
+
+        //! Date and time text for a header, only rendered in full once a second per thread
+        //! \note Gives exactly what streaming `year_month_day` and `make_time()` would, the sub-second digits have the
+        //!       precision of the clock, so they're just the ticks into the second
+        const timestampCache &timestampText(std::chrono::system_clock::time_point logTime)
+        {
+            thread_local timestampCache cache;
+            auto second(date::floor<std::chrono::seconds>(logTime));
+
+            if(second != cache.second)
+            {
+                auto day(date::floor<date::days>(logTime));
+                std::ostringstream text;
+
+                text << date::year_month_day{day};
+                cache.date = text.str();
+
+                text.str(std::string());
+                text << date::make_time(logTime - day);
+                cache.time = text.str();
+
+                cache.fraction = cache.time.find('.');
+
+                if(cache.fraction != std::string::npos)
+                {
+                    ++cache.fraction;
+                }
+
+                cache.second = second;
+            }
+            else if(cache.fraction != std::string::npos)
+            {
+                auto ticks((logTime - second).count());
+
+                for(auto digit(cache.time.size()); digit > cache.fraction; --digit, ticks /= 10)
+                {
+                    cache.time[digit - 1] = static_cast<char>('0' + ticks % 10);
+                }
+            }
+
+            return cache;
+        }
     }
 
     const boost::format message::getMessageHeaderConst(std::string formatStr) const
     {
-            auto log_time_point(getDate());
-            auto log_date(date::floor<date::days>(log_time_point));
-            auto date = date::year_month_day{log_date};
-            auto time(date::make_time(log_time_point - log_date));
+            const auto &timestamp(timestampText(getDate()));
             std::string levelText;
             auto levelIterator(logLevelLables.find(getLevel()));
 
@@ -102,7 +391,8 @@ namespace LogXX
                 levelText = "level:" + std::to_string(getLevel());
             }
 
-            std::string prettyFunc(m_extendedFunction.empty() ? m_function : m_extendedFunction);
+            const char *prettyFunc(*getExtendedFunction() ? getExtendedFunction() : getFunction());
+            auto file(getFile());
 
             // Add format string to print nothing for all arguments at the end
             boost::format header(formatStr);
@@ -110,35 +400,205 @@ namespace LogXX
             // Mismatched number of arguements are expected here
             header.exceptions(boost::io::all_error_bits ^ (boost::io::too_few_args_bit | boost::io::too_many_args_bit));
 
-            header % date
-                   % time
+            header % timestamp.date
+                   % timestamp.time
                    % levelText
                    % getThreadID()
-                   % getFile().filename()
-                   % getFile()
+                   % file.filename()
+                   % file
                    % prettyFunc
-                   % m_function
-                   % m_extendedFunction;
+                   % getFunction()
+                   % getExtendedFunction();
 
             return header;
     }
 
-    const boost::format message::getMessageHeader(std::string formatStr)
+    namespace
+    {
+        //! Most thread IDs threadText() keeps before starting over
+        constexpr size_t maxCachedThreads = 1024;
+
+        //! Quoted file name and path of a call site file, the way streaming a `boost::filesystem::path` writes them
+        struct fileText
+        {
+            std::string filename;
+            std::string path;
+        };
+
+        //! File text for a header, rendered once per file per thread
+        //! \note Call site files are string literals, so the pointer identifies the file
+        const fileText &fileNameText(const char *file)
+        {
+            thread_local std::unordered_map<const char *, fileText> cache;
+            auto found(cache.find(file));
+
+            if(found == cache.end())
+            {
+                boost::filesystem::path filePath(file);
+                std::ostringstream text;
+                fileText entry;
+
+                text << filePath.filename();
+                entry.filename = text.str();
+
+                text.str(std::string());
+                text << filePath;
+                entry.path = text.str();
+
+                found = cache.emplace(file, std::move(entry)).first;
+            }
+
+            return found->second;
+        }
+
+        //! Thread ID text for a header, rendered once per thread ID per thread
+        const std::string &threadText(std::thread::id threadID)
+        {
+            thread_local std::unordered_map<std::thread::id, std::string> cache;
+            auto found(cache.find(threadID));
+
+            if(found == cache.end())
+            {
+                // Threads come and go, don't hold on to every ID ever seen
+                if(cache.size() >= maxCachedThreads)
+                {
+                    cache.clear();
+                }
+
+                std::ostringstream text;
+                text << threadID;
+                found = cache.emplace(threadID, text.str()).first;
+            }
+
+            return found->second;
+        }
+    }
+
+    headerLayout::headerLayout(const std::string &formatStr)
+        : m_format(formatStr)
+        , m_compiled(true)
     {
-        if(formatStr.empty())
-            formatStr = m_defaultFormatString;
+        // Anything boost::format would reject is rejected here, once, rather than for every message
+        boost::format check(m_format);
+
+        auto addText([this](const char *text, size_t length)
+        {
+            if(!m_entries.empty() && m_entries.back().kind == FIELD_TEXT)
+            {
+                m_entries.back().length += length;
+            }
+            else
+            {
+                m_entries.push_back({FIELD_TEXT, m_text.size(), length});
+            }
+
+            m_text.append(text, length);
+        });
+
+        size_t position(0);
+
+        while(position < m_format.size())
+        {
+            size_t percent(m_format.find('%', position));
+
+            if(percent != position)
+            {
+                size_t end(std::min(percent, m_format.size()));
+                addText(m_format.data() + position, end - position);
+                position = end;
+                continue;
+            }
+
+            if(percent + 1 < m_format.size() && m_format[percent + 1] == '%')
+            {
+                addText("%", 1);
+                position = percent + 2;
+                continue;
+            }
+
+            // Only plain "%N%" directives are compiled, leave anything fancier to boost::format
+            size_t digits(m_format.find_first_not_of("0123456789", percent + 1));
+
+            if(digits == percent + 1 || digits == std::string::npos || m_format[digits] != '%' || digits - percent > 3)
+            {
+                m_compiled = false;
+                m_entries.clear();
+                m_text.clear();
+                return;
+            }
+
+            auto argument(std::stoul(m_format.substr(percent + 1, digits - percent - 1)));
+            m_entries.push_back({argument < FIELD_NONE ? static_cast<field>(argument) : FIELD_NONE, 0, 0});
+            position = digits + 1;
+        }
+    }
 
-        if(m_headers.count(formatStr) == 0)
+    void headerLayout::render(const message &msg, std::string &out) const
+    {
+        if(!m_compiled)
         {
-            m_headers.insert({formatStr, getMessageHeaderConst(formatStr)});
+            out += msg.getMessageHeaderConst(m_format).str();
+            return;
         }
 
-        return m_headers[formatStr];
+        for(const auto &item : m_entries)
+        {
+            switch(item.kind)
+            {
+                case FIELD_TEXT:
+                    out.append(m_text, item.offset, item.length);
+                    break;
+
+                case FIELD_DATE:
+                    out += timestampText(msg.getDate()).date;
+                    break;
+
+                case FIELD_TIME:
+                    out += timestampText(msg.getDate()).time;
+                    break;
+
+                case FIELD_LEVEL:
+                    out += message::levelToString(msg.getLevel());
+                    break;
+
+                case FIELD_THREAD:
+                    out += threadText(msg.getThreadID());
+                    break;
+
+                case FIELD_FILENAME:
+                    out += fileNameText(msg.getCallsite().getFile()).filename;
+                    break;
+
+                case FIELD_PATH:
+                    out += fileNameText(msg.getCallsite().getFile()).path;
+                    break;
+
+                case FIELD_PRETTY_FUNCTION:
+                    out += *msg.getExtendedFunction() ? msg.getExtendedFunction() : msg.getFunction();
+                    break;
+
+                case FIELD_FUNCTION:
+                    out += msg.getFunction();
+                    break;
+
+                case FIELD_EXTENDED_FUNCTION:
+                    out += msg.getExtendedFunction();
+                    break;
+
+                case FIELD_NONE:
+                    break;
+            }
+        }
     }
 
     std::ostream &operator <<(std::ostream &os, const std::shared_ptr<message> msg)
     {
-        os << msg->getMessageHeader() << ' ' << msg->getMessageBody() << std::endl;
+        static const headerLayout defaultLayout;
+        thread_local std::string header;
+
+        header.clear();
+        defaultLayout.render(*msg, header);
+        os << header << ' ' << msg->getMessageBody();
 
         return os;
     }
@@ -18,12 +18,16 @@
 #include <cstdint>
 #include <chrono>
 #include <memory>
+#include <atomic>
 #include <mutex>
 #include <system_error>
 #include <queue>
 #include <thread>
 #include <condition_variable>
 #include <unordered_map>
+#include <vector>
+#include <new>
+#include <type_traits>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 
@@ -31,6 +35,10 @@
 
 #include "log_hash.h"
 #include "log_format.h"
+#include "log_format_table.h"
+#include "log_arguments.h"
+#include "log_pool.h"
+#include "log_clock.h"
 
 namespace LogXX
 {
@@ -46,113 +54,394 @@ namespace LogXX
         LOG_ALL      //!< turn on all logging
     };
 
-    //! Container class for log message
-    class message : public std::enable_shared_from_this<message>
+    //! Static description of a single `_log` expansion, shared by every message logged from it
+    //! \details The location strings are literals that live for the whole program, messages only keep a pointer to the call
+    //!          site they came from. Each call site also caches the log level the configuration enables for it, tagged with
+    //!          the generation of the configuration it came from. Checking a call site is a couple of relaxed loads and a
+    //!          compare, messages that would be rejected are never allocated or formatted.
+    //!
+    //!          A call site can also be rate limited, see admit(). Call sites are keyed on their `LINECRC` hash, so the
+    //!          limit applies to one line of code however many threads log from it.
+    class callsite
     {
         public:
-            message(const std::string &defaultFormatString = "%1% %2% %3% [%4%] %5% %7%")
-                : m_line(0)
-                , m_level(LOG_DEBUG)
-                , m_logTime(std::chrono::system_clock::now())
-                , m_threadID(std::this_thread::get_id())
-                , m_defaultFormatString(defaultFormatString)
+            /**
+             * Describe a call site
+             * @param[in] file             source file, typically the `__FILE__` macro
+             * @param[in] function         function name, typically the `__func__` macro
+             * @param[in] extendedFunction a more descriptive function name like GCCs `__PRETTY_FUNCTION__` or MSVCs `__FUNCSIG__`
+             * @param[in] className        name of the class associated with the log message, this must be managed manually
+             * @param[in] module           name of an arbitrary grouping of log messages
+             * @param[in] line             line number, typically the `__LINE__` macro
+             * @param[in] level            log level used at the call site
+             * @param[in] hash             a unique hash used to identify the call site, see the `LINECRC` macro
+             * @note All strings must outlive the call site, string literals are expected
+             */
+            constexpr callsite(const char *file = "",
+                               const char *function = "",
+                               const char *extendedFunction = "",
+                               const char *className = "",
+                               const char *module = "",
+                               uint32_t line = 0,
+                               levels level = LOG_DEBUG,
+                               uint64_t hash = 0)
+                : m_file(file)
+                , m_function(function)
+                , m_extendedFunction(extendedFunction)
+                , m_class(className)
+                , m_module(module)
+                , m_line(line)
+                , m_level(level)
+                , m_hash(hash)
+                , m_state(0)
+                , m_interval(0)
+                , m_tolerance(0)
+                , m_due(0)
+                , m_suppressed(0)
+                , m_listed(false)
+                , m_nextSuppressed(nullptr)
             {
             }
 
-            message(const boost::filesystem::path &file, const std::string &function, uint32_t line, levels level) = delete;
-            message(const message &) = delete;
-            message(const message &&) = delete;
+            callsite(const callsite &) = delete;
+            callsite &operator=(const callsite &) = delete;
 
-            /** @name Message construction
-            *  These are a collection of functions to be used to construct a debug mesage, typically from within a macro
+            //! Check if a message at `level` from this call site should be built
+            //! \note Unresolved call sites are enabled so the manager gets a chance to resolve them
+            bool enabled(levels level) const
+            {
+                uint32_t generation(m_generation.load(std::memory_order_relaxed));
+                uint32_t state(m_state.load(std::memory_order_relaxed));
+
+                if(generation == 0)
+                {
+                    return false;
+                }
+
+                if((state >> generationShift) != generation)
+                {
+                    return true;
+                }
+
+                // Messages only built for capture don't count against the rate limit
+                if(level <= static_cast<levels>((state >> levelBits) & levelMask))
+                {
+                    return admit();
+                }
+
+                return level <= static_cast<levels>(state & levelMask);
+            }
+
+            //! Take a message from the rate limit, true if it may be logged
+            //! \details A token bucket kept as the time the bucket will next be empty, the generic cell rate algorithm. Each
+            //!          message pushes that time on by the interval between messages, messages that would push it further
+            //!          than the burst allows ahead of now are suppressed. Unlimited call sites pay one relaxed load,
+            //!          limited ones a read of the coarse clock and a compare and swap.
+            //! \note Suppressed messages are counted for the manager, which logs a summary of them, see takeSuppressed()
+            bool admit() const
+            {
+                int64_t interval(m_interval.load(std::memory_order_relaxed));
+
+                if(interval == 0)
+                {
+                    return true;
+                }
+
+                int64_t now(coarseClock::now());
+                int64_t due(m_due.load(std::memory_order_relaxed));
+
+                do
+                {
+                    if(due - now > m_tolerance.load(std::memory_order_relaxed))
+                    {
+                        suppress();
+                        return false;
+                    }
+                }
+                while(!m_due.compare_exchange_weak(due, (due > now ? due : now) + interval, std::memory_order_relaxed));
+
+                return true;
+            }
+
+            //! Set the rate limit
+            //! \param[in] rate  messages per second, 0 for no limit
+            //! \param[in] burst messages that may be logged at once after a quiet spell, at least 1
+            void limit(double rate, double burst) const;
+
+            //! True if the rate limit has recovered completely since the last message, `now` is from coarseClock
+            bool refilled(int64_t now) const
+            {
+                return m_due.load(std::memory_order_relaxed) <= now;
+            }
+
+            //! Get the number of messages suppressed since the last call, and reset it
+            //! \param[in] release take the call site off the suppressed list, the next suppressed message puts it back
+            uint64_t takeSuppressed(bool release) const
+            {
+                if(release)
+                {
+                    // Before taking the count, a message suppressed after this lists the call site again
+                    m_listed.store(false);
+                }
+
+                return m_suppressed.exchange(0);
+            }
+
+            //! Take the list of call sites that suppressed messages since they were last released, log thread only
+            //! \note Follow the list with nextSuppressed(), call sites stay off it until released by takeSuppressed()
+            static const callsite *takeSuppressedList()
+            {
+                return m_suppressedList.exchange(nullptr, std::memory_order_acquire);
+            }
+
+            //! Next call site on the list from takeSuppressedList()
+            const callsite *nextSuppressed() const
+            {
+                return m_nextSuppressed;
+            }
+
+            //! True if a message at `level` is built only for capture, because it is below the level the configuration enables
+            bool captureOnly(levels level) const
+            {
+                uint32_t state(m_state.load(std::memory_order_relaxed));
+
+                return (state >> generationShift) == m_generation.load(std::memory_order_relaxed) &&
+                       level > static_cast<levels>((state >> levelBits) & levelMask);
+            }
+
+            //! Get the level the configuration enables for this call site
+            //! \return false if the call site has not been resolved against the current configuration
+            bool resolved(levels &level) const
+            {
+                uint32_t state(m_state.load(std::memory_order_relaxed));
+
+                if((state >> generationShift) != m_generation.load(std::memory_order_relaxed))
+                {
+                    return false;
+                }
+
+                level = static_cast<levels>((state >> levelBits) & levelMask);
+                return true;
+            }
+
+            //! Cache the levels for this call site from the given configuration generation
+            //! \param[in] level      level enabled by the configuration
+            //! \param[in] capture    level messages are built at, may be higher than `level` if something wants every message
+            //! \param[in] generation configuration generation the levels came from
+            void resolve(levels level, levels capture, uint32_t generation) const
+            {
+                m_state.store((generation << generationShift) |
+                              ((static_cast<uint32_t>(level) & levelMask) << levelBits) |
+                              (static_cast<uint32_t>(capture) & levelMask), std::memory_order_relaxed);
+            }
+
+            //! Current configuration generation, 0 when there is no manager to log to
+            static uint32_t generation()
+            {
+                return m_generation.load(std::memory_order_relaxed);
+            }
+
+            //! Throw away every cached call site level, call sites are resolved again on their next message
+            static void invalidate();
+
+            //! Disable every call site until the next invalidate()
+            static void disable()
+            {
+                m_generation.store(0, std::memory_order_relaxed);
+            }
+
+            //! Call site for messages that are not logged through the `_log` macros
+            static const callsite &unknown();
+
+            /** @name Accessors
+            *  Functions to access call site components
             */
             ///@{
-            /**
-             * Set the filename of the source file
-             * @param[in] path filename that log message occurs in
-             * @note Typically this function is called with the ```__FILE__``` macro
-             */
-            message *set_file(const boost::filesystem::path &path)
+            // *INDENT-OFF*
+            const char *getFile()             const { return m_file; }             //!< Get call site file
+            const char *getFunction()         const { return m_function; }         //!< Get call site function
+            const char *getExtendedFunction() const { return m_extendedFunction; } //!< Get call site extended function name
+            const char *getClass()            const { return m_class; }            //!< Get call site class
+            const char *getModule()           const { return m_module; }           //!< Get call site module
+            uint32_t    getLine()             const { return m_line; }             //!< Get call site line number
+            levels      getLevel()            const { return m_level; }            //!< Get call site log level
+            uint64_t    getHash()             const { return m_hash; }             //!< Get call site hash
+            // *INDENT-ON*
+            ///@}
+
+        private:
+            static constexpr uint32_t levelBits = 4;
+            static constexpr uint32_t levelMask = (1u << levelBits) - 1;
+            static constexpr uint32_t generationShift = 2 * levelBits;
+
+            //! Count a message over the rate limit, and put the call site on the suppressed list
+            void suppress() const;
+
+            const char                     *m_file;
+            const char                     *m_function;
+            const char                     *m_extendedFunction;
+            const char                     *m_class;
+            const char                     *m_module;
+            uint32_t                        m_line;
+            levels                          m_level;
+            uint64_t                        m_hash;
+            mutable std::atomic<uint32_t>   m_state;        //!< configuration generation, configured and capture levels
+            mutable std::atomic<int64_t>    m_interval;     //!< nanoseconds between messages, 0 for no rate limit
+            mutable std::atomic<int64_t>    m_tolerance;    //!< how far m_due may run ahead of now, in nanoseconds
+            mutable std::atomic<int64_t>    m_due;          //!< coarseClock time the rate limit's bucket is empty until
+            mutable std::atomic<uint64_t>   m_suppressed;   //!< messages over the rate limit since the last summary
+            mutable std::atomic<bool>       m_listed;       //!< on the suppressed list, or held by the manager
+            mutable const callsite         *m_nextSuppressed;
+            static std::atomic<uint32_t>    m_generation;   //!< generation of the active configuration
+            static std::atomic<uint32_t>    m_lastGeneration;
+            static std::atomic<const callsite *> m_suppressedList; //!< call sites with messages to summarise
+    };
+
+    //! `std::streambuf` that appends to a `std::string`, so text can be formatted straight into a write buffer
+    class appendBuffer : public std::streambuf
+    {
+        public:
+            explicit appendBuffer(std::string &buffer) : m_buffer(buffer)
             {
-                m_file = path;
-                return this;
             }
 
-            /**
-              * Set the function name
-              * @param[in] func function name
-              * @note Typically this function is called with the  ``__func__`` macro
-              */
-            message *set_function(const std::string &func)
+        protected:
+            int_type overflow(int_type ch) override
             {
-                m_function = func;
-                return this;
+                if(!traits_type::eq_int_type(ch, traits_type::eof()))
+                {
+                    m_buffer.push_back(traits_type::to_char_type(ch));
+                }
+
+                return traits_type::not_eof(ch);
             }
 
-            /**
-             * Set the line number
-              * @param[in] line line number
-              * @note Typically this function is called with the  `__LINE__` macro
-             */
-            message *set_line(uint32_t line)
+            std::streamsize xsputn(const char *str, std::streamsize count) override
             {
-                m_line = line;
-                return this;
+                m_buffer.append(str, count);
+                return count;
             }
 
-            //! Set the log level
-            //! \param[in] level Set the log level
-            message *set_level(levels level)
+        private:
+            std::string &m_buffer;
+    };
+
+    //! A message body as getMessageBody() hands it out, a `boost::format` or text that needed no formatting
+    class messageBody
+    {
+        public:
+            explicit messageBody(const boost::format &format) : m_format(&format), m_text(nullptr)
             {
-                m_level = level;
-                return this;
             }
 
-            //! Set a unique hash for the log message
-            //! \param[in] hash a unique hash used to identify a log message location
-            //! \note the provided `LINECRC` macro is provieded to generate a CRC64 based on `__FILE__`, `__LINE__ and `__func__` at compile time
-            message *set_hash(uint64_t hash)
+            explicit messageBody(const std::string &text) : m_format(nullptr), m_text(&text)
             {
-                m_hash = hash;
+            }
 
-                return this;
+            //! The body text
+            std::string str() const
+            {
+                return m_text ? *m_text : m_format->str();
             }
 
-            //! Set a more descriptive function name
-            //! \param[in] func a more descriptive function macro
-            //! \note used to wrap the compiler specific function name macros like GCCs `__PRETTY_FUNCTION__` or MSVCs `__FUNCSIG__`
-            message *set_extendedFunction(const std::string &func)
+            friend std::ostream &operator<<(std::ostream &os, const messageBody &body)
             {
-                m_extendedFunction = func;
-                return this;
+                return body.m_text ? os << *body.m_text : os << *body.m_format;
+            }
+
+        private:
+            const boost::format    *m_format;
+            const std::string      *m_text;
+    };
+
+    //! Container class for log message
+    class message : public std::enable_shared_from_this<message>
+    {
+        public:
+            //! Header format used unless a message asks for another one
+            static constexpr const char *defaultHeaderFormat = "%1% %2% %3% [%4%] %5% %7%";
+
+            //! Create a message logged from `site`
+            message(const callsite &site = callsite::unknown())
+                : m_callsite(&site)
+                , m_level(site.getLevel())
+                , m_ticks(tscClock::enabled() ? tscClock::ticks() : 0)
+                , m_logTime(m_ticks ? std::chrono::system_clock::time_point() : std::chrono::system_clock::now())
+                , m_sequence(nextSequence())
+                , m_threadID(std::this_thread::get_id())
+                , m_arguments(nullptr)
+                , m_captureSlot(false)
+                , m_textBody(false)
+            {
+            }
+
+            //! Create a message logged from `site` with a log level chosen at run time
+            message(const callsite &site, levels level)
+                : message(site)
+            {
+                m_level = level;
+            }
+
+            ~message()
+            {
+                releaseArguments();
             }
 
-            //! Associate message with a class
-            //! \param[in] className name of the class associated with the log message
-            //! \note This must be managed manually, there is no generic way of accessing class name data, _afaik_.
-            message *set_class(const std::string &className)
+            //! Get a message logged from `site`, recycling a message the log thread is done with when possible
+            //! \note Messages created this way return to the pool, along with their buffers, when the last reference goes away.
+            //!       Messages only the crash ring keeps never reach the log thread, each thread reuses one message for those.
+            static std::shared_ptr<message> create(const callsite &site, levels level);
+
+            //! Copy a message create() lent for capture into a pooled one, formatting any captured arguments first
+            //! \note For a capture message whose call site turned out to be enabled, e.g. after a configuration reload, the
+            //!       lent message belongs to the logging thread and must never be queued
+            std::shared_ptr<message> detach();
+
+            message(const boost::filesystem::path &file, const std::string &function, uint32_t line, levels level) = delete;
+            message(const message &) = delete;
+            message(const message &&) = delete;
+
+            /** @name Message construction
+            *  These are a collection of functions to be used to construct a debug mesage, typically from within a macro
+            */
+            ///@{
+            //! Set the log level
+            //! \param[in] level Set the log level
+            message *set_level(levels level)
             {
-                m_class = className;
+                m_level = level;
                 return this;
             }
 
-            //! Associate message with an arbitrary module
-            //! \param[in] module name of the module associated with the log message
-            //! \note This is intended to allow log messages to be associated with arbitrary groupings
-            message *set_module(const std::string &module)
+            //! Set the message timestamp
+            message *set_date(const std::chrono::system_clock::time_point &logTime)
             {
-                m_module = module;
+                m_ticks = 0;
+                m_logTime = logTime;
                 return this;
             }
 
-            //! Set the default header format string
-            message *set_header_format_string(const std::string &formatString)
+            //! Set the ID of the thread the message was logged from
+            message *set_threadID(const std::thread::id &threadID)
             {
-                m_defaultFormatString = formatString;
+                m_threadID = threadID;
                 return this;
             }
+
             ///@}
 
+            //! Stamp new messages with a global sequence number, or stop, see manager::setReorderWindow()
+            static void useSequence(bool enable)
+            {
+                m_sequencing.store(enable);
+            }
+
+            //! Next number in the order messages are created in, 0 while sequence numbers are off
+            static uint64_t nextSequence()
+            {
+                return m_sequencing.load(std::memory_order_relaxed) ? m_nextSequence.fetch_add(1, std::memory_order_relaxed) + 1 : 0;
+            }
+
             //! Helper to convert text to level
             static levels stringToLevel(const std::string &levelStr);
 
@@ -170,15 +459,79 @@ namespace LogXX
              *  @param[in] fmtStr a printf style format string (see boost::format for details)
              *  @param[in] args   arguments to log
              */
-            template <typename... Args>
-            message *format(const std::string &fmtStr, const Args &... args)
+            template <typename FormatString, typename... Args>
+            message *format(const FormatString &fmtStr, const Args &... args)
             {
-                m_format = boost::format(fmtStr);
+                // Parsing into the existing objects lets a recycled message reuse its buffers
+                m_formatString.assign(fmtStr);
+                m_format.parse(m_formatString);
+                m_format.clear();
+                m_textBody = false;
                 print(m_format, args...);
 
                 return this;
             }
 
+            /**
+             *  Format log message from a compile time parsed format string
+             *  @param[in] table  the format string, parsed, see `LOGXX_STATIC_FORMAT`
+             *  @param[in] fmtStr the same format string, unused
+             *  @param[in] args   arguments to log, `table.arguments()` of them
+             *  @note Simple formats are rendered straight into the message text, without a `boost::format` at all, the
+             *        rest go through format()
+             */
+            template <size_t N, typename... Args>
+            message *formatStatic(const formatTable<N> &table, const char *fmtStr, const Args &... args)
+            {
+                static_cast<void>(fmtStr);
+
+                if(!table.simple())
+                {
+                    return format(table.text(), args...);
+                }
+
+                m_formatString.clear();
+                table.render(m_formatString, args...);
+                m_textBody = true;
+
+                return this;
+            }
+
+            //! Set the message body to ready formatted text
+            //! \param[in] text the body, `%` needs no escaping
+            message *set_text(const std::string &text);
+
+            /**
+             *  Capture a log message to be formatted later on the log thread
+             *  @param[in] fmtStr a printf style format string (see boost::format for details)
+             *  @param[in] args   arguments to log, copied into the message
+             *  @note `print()` overloads for the argument types are resolved here, but only run when the message is formatted
+             */
+            template <typename FormatString, typename... Args>
+            message *defer(const FormatString &fmtStr, const Args &... args)
+            {
+                using pack = capturedArguments<Args...>;
+
+                releaseArguments();
+                m_formatString.assign(fmtStr);
+                m_textBody = false;
+
+                if(sizeof(pack) <= sizeof(m_argumentStorage) && alignof(pack) <= alignof(std::max_align_t))
+                {
+                    m_arguments = new(&m_argumentStorage) pack(args...);
+                }
+                else
+                {
+                    m_arguments = new pack(args...);
+                }
+
+                return this;
+            }
+
+            //! Format captured arguments, if any
+            //! \note Called by the manager before the message is handed to the log back ends
+            void formatDeferred();
+
             ///@}
 
             /** @name Accessors
@@ -186,25 +539,30 @@ namespace LogXX
             */
             ///@{
             // *INDENT-OFF*
-            std::string getMessage() const;                     //!< Get formatted log message
-            uint32_t    getLine()     const { return m_line; }  //!< Get log message line number
-            levels      getLevel()    const { return m_level; } //!< Get log message log level
-
-            const boost::filesystem::path               &getFile()     const { return m_file; }     //!< Get log message file
-            const std::string                           &getFunction() const { return m_function; } //!< Get log message function
-            const std::string                           &getClass()    const { return m_class; }    //!< Get log message class
-            const std::string                           &getModule()   const { return m_module; }   //!< Get log message module
-            const std::chrono::system_clock::time_point &getDate()     const { return m_logTime; }  //!< Get log message timestamp
+            std::string getMessage() const;                                     //!< Get formatted log message
+            uint32_t    getLine()             const { return m_callsite->getLine(); }             //!< Get log message line number
+            levels      getLevel()            const { return m_level; }                           //!< Get log message log level
+            const char *getFunction()         const { return m_callsite->getFunction(); }         //!< Get log message function
+            const char *getExtendedFunction() const { return m_callsite->getExtendedFunction(); } //!< Get log message extended function name
+            const char *getClass()            const { return m_callsite->getClass(); }            //!< Get log message class
+            const char *getModule()           const { return m_callsite->getModule(); }           //!< Get log message module
+            uint64_t    getHash()             const { return m_callsite->getHash(); }             //!< Get log message hash
+            const callsite &getCallsite()     const { return *m_callsite; }                       //!< Get log message call site
+
+            boost::filesystem::path                      getFile()     const { return m_callsite->getFile(); } //!< Get log message file
+            const std::chrono::system_clock::time_point &getDate()     const { return m_logTime; }  //!< Get log message timestamp, see getTicks()
+            uint64_t                                     getTicks()    const { return m_ticks; }    //!< Cycle counter stamp the log thread has yet to convert, 0 once getDate() is valid
+            uint64_t                                     getSequence() const { return m_sequence; } //!< Global creation order, 0 unless the manager orders messages
             const std::thread::id                       &getThreadID() const { return m_threadID; } //!< Get log message thread ID
-            uint64_t                                     getHash()     const { return m_hash; }     //!< Get log message hash
+            bool                                         isCaptureSlot() const { return m_captureSlot; } //!< Lent by create() for the crash ring only, see detach()
 
             // *INDENT-ON*
             ///@}
 
-            //! Get the raw boost format object, usable for streaming
-            const boost::format &getMessageBody() const
+            //! Get the message body, usable for streaming
+            messageBody getMessageBody() const
             {
-                return m_format;
+                return m_textBody ? messageBody(m_formatString) : messageBody(m_format);
             }
 
             //! \brief Get the raw boost format object for the header, usable for streaming
@@ -220,33 +578,191 @@ namespace LogXX
             //!    - `%9%` Extended function name
             //!
             //! The default format string is `"%1% %2% %3% [%4%] %5% %7%"`
-            const boost::format getMessageHeader(std::string formatStr);
+            //! \note Log back ends render headers with a headerLayout, which parses the format string once rather than
+            //!       for every message
             const boost::format getMessageHeaderConst(std::string formatStr) const;
             const boost::format getMessageHeader() const
             {
-                // We should always pregenerate the default header
-                if(m_headers.count(m_defaultFormatString))
-                    return m_headers.find(m_defaultFormatString)->second;
-                
-                return getMessageHeaderConst(m_defaultFormatString);
+                return getMessageHeaderConst(defaultHeaderFormat);
             }
 
 
         private:
+            const callsite                         *m_callsite;
             boost::format                           m_format;
-            boost::filesystem::path                 m_file;
-            std::string                             m_function;
-            std::string                             m_extendedFunction;
-            std::string                             m_class;
-            std::string                             m_module;
-            uint32_t                                m_line;
-            uint64_t                                m_hash;
             levels                                  m_level;
+            uint64_t                                m_ticks;        //!< tscClock stamp, 0 when m_logTime is set
             std::chrono::system_clock::time_point   m_logTime;
+            uint64_t                                m_sequence;     //!< see nextSequence()
             std::thread::id                         m_threadID;
-            std::string                             m_defaultFormatString;
+            std::string                             m_formatString; //!< the format string, or the body if m_textBody
+            argumentPack                           *m_arguments;
+            bool                                    m_captureSlot;  //!< lives in the logging thread's storage, see create()
+            bool                                    m_textBody;     //!< m_formatString is the finished body, m_format is unused
+
+            //! Inline storage so most deferred messages don't need an extra allocation for their arguments
+            typename std::aligned_storage<96, alignof(std::max_align_t)>::type m_argumentStorage;
+
+            static std::atomic<bool>                m_sequencing;
+            static std::atomic<uint64_t>            m_nextSequence;
+
+            //! shared_ptr deleter that returns messages to the pool
+            struct recycler;
+
+            //! shared_ptr deleter for a thread's capture message, see create()
+            struct captureRelease;
+
+            //! Get a message from the pool, or a new one
+            static std::shared_ptr<message> pooled(const callsite &site, levels level);
+
+            //! Prepare a recycled message for reuse
+            void reset(const callsite &site, levels level);
 
-            std::unordered_map<std::string, boost::format> m_headers;
+            //! Destroy captured arguments
+            void releaseArguments()
+            {
+                if(m_arguments == reinterpret_cast<argumentPack *>(&m_argumentStorage))
+                {
+                    m_arguments->~argumentPack();
+                }
+                else
+                {
+                    delete m_arguments;
+                }
+
+                m_arguments = nullptr;
+            }
+    };
+
+    //! A header format string parsed once into the fields it prints
+    //! \details Understands the `%N%` and `%%` directives header formats use, see message::getMessageHeader() for the
+    //!          fields, and appends each field straight to the output, no `boost::format` is built per message. Formats
+    //!          using any other `boost::format` directive are rendered through `boost::format`, with the same output.
+    class headerLayout
+    {
+        public:
+            //! Parse `formatStr`
+            //! \throw boost::io::format_error if `formatStr` is not a valid `boost::format` string
+            explicit headerLayout(const std::string &formatStr = message::defaultHeaderFormat);
+
+            //! Append the header of `msg` to `out`
+            void render(const message &msg, std::string &out) const;
+
+            //! Get the format string this layout was parsed from
+            const std::string &getFormat() const
+            {
+                return m_format;
+            }
+
+        private:
+            //! What an entry in the layout prints, the values follow the header format argument numbers
+            enum field : uint8_t
+            {
+                FIELD_TEXT,                 //!< literal text
+                FIELD_DATE,                 //!< `%1%`
+                FIELD_TIME,                 //!< `%2%`
+                FIELD_LEVEL,                //!< `%3%`
+                FIELD_THREAD,               //!< `%4%`
+                FIELD_FILENAME,             //!< `%5%`
+                FIELD_PATH,                 //!< `%6%`
+                FIELD_PRETTY_FUNCTION,      //!< `%7%`
+                FIELD_FUNCTION,             //!< `%8%`
+                FIELD_EXTENDED_FUNCTION,    //!< `%9%`
+                FIELD_NONE                  //!< argument past the last one, prints nothing
+            };
+
+            struct entry
+            {
+                field   kind;
+                size_t  offset;             //!< FIELD_TEXT, start of the text in m_text
+                size_t  length;             //!< FIELD_TEXT, length of the text
+            };
+
+            std::string         m_format;
+            std::string         m_text;         //!< literal text of every FIELD_TEXT entry
+            std::vector<entry>  m_entries;
+            bool                m_compiled;     //!< false if m_format needs the full `boost::format`
+    };
+
+    //! Builds the body of a streamed log message, see the `_log_s` macros
+    //! \details The text is streamed into a buffer kept by the thread, so its capacity is reused from one message to
+    //!          the next and no stream is constructed per message. The message is posted by post(), a message whose
+    //!          streaming threw is dropped.
+    class messageStream
+    {
+        public:
+            //! Start a message from `site`, if the call site is enabled at `level`
+            messageStream(const callsite &site, levels level)
+                : m_buffer(nullptr)
+            {
+                if(site.enabled(level))
+                {
+                    start(site, level);
+                }
+            }
+
+            //! Start a message from `site` at `level`, nothing is started if `site` is nullptr
+            //! \note For call sites `_log_s` has already checked
+            messageStream(const callsite *site, levels level)
+                : m_buffer(nullptr)
+            {
+                if(site)
+                {
+                    start(*site, level);
+                }
+            }
+
+            ~messageStream()
+            {
+                if(m_buffer)
+                {
+                    m_buffer->busy = false;
+                }
+            }
+
+            messageStream(const messageStream &) = delete;
+            messageStream &operator=(const messageStream &) = delete;
+
+            //! True until the message has been posted, false from the start if the call site is disabled
+            bool pending() const
+            {
+                return static_cast<bool>(m_message);
+            }
+
+            //! Hand the message to the manager
+            void post();
+
+            //! Stream a value into the message
+            template <typename T>
+            std::ostream &operator<<(const T &value)
+            {
+                return m_buffer->stream << value;
+            }
+
+            //! Stream a manipulator such as `std::endl` into the message
+            std::ostream &operator<<(std::ostream &(*manipulator)(std::ostream &))
+            {
+                return m_buffer->stream << manipulator;
+            }
+
+        private:
+            //! Take a buffer and create the message
+            void start(const callsite &site, levels level);
+
+            //! Text and stream a thread reuses for every message it streams
+            struct buffer
+            {
+                buffer();
+
+                std::string     text;
+                appendBuffer    appender;
+                std::ostream    stream;
+                bool            busy;       //!< in use by a message, a nested one gets a buffer of its own
+            };
+
+            std::shared_ptr<message>    m_message;
+            buffer                     *m_buffer;
+            std::unique_ptr<buffer>     m_nested;   //!< owns m_buffer when the thread's buffer was busy
     };
 
     //! print specialization for log level
@@ -277,19 +793,49 @@ namespace LogXX
 #define LOG_MODULE ""
 #endif
 
+// Define LOGXX_DEFERRED_FORMAT to copy arguments at the call site and format them on the log thread
+#ifdef LOGXX_DEFERRED_FORMAT
+#define LOG_FORMAT defer
+#else
+#define LOG_FORMAT format
+#endif
+
+// Define LOGXX_STATIC_FORMAT to parse and check format strings at compile time, they must be string literals
+#define LOGXX_FIRST(FIRST, ...) FIRST
+
+#ifdef LOGXX_STATIC_FORMAT
+#define LOGXX_CHECK_FORMAT(...)                                                                     \
+        static constexpr LogXX::formatTable<sizeof(LOGXX_FIRST(__VA_ARGS__, 0))>                    \
+            logxx_format(LOGXX_FIRST(__VA_ARGS__, 0));                                              \
+        static_assert(logxx_format.valid(), "log format string is not a valid boost::format string"); \
+        static_assert(logxx_format.arguments() == decltype(LogXX::formatArguments(__VA_ARGS__))::value, \
+                      "log format string and argument count don't match");
+#ifdef LOGXX_DEFERRED_FORMAT
+#define LOGXX_APPLY_FORMAT(...) defer(__VA_ARGS__)
+#else
+#define LOGXX_APPLY_FORMAT(...) formatStatic(logxx_format, __VA_ARGS__)
+#endif
+#else
+#define LOGXX_CHECK_FORMAT(...)
+#define LOGXX_APPLY_FORMAT(...) LOG_FORMAT(__VA_ARGS__)
+#endif
+
 //! Example/sample log macro
-#define _log(LOG_LEVEL, ...)                \
-    std::make_shared<LogXX::message>()->    \
-        set_level(LOG_LEVEL)->              \
-        set_file(__FILE__)->                \
-        set_function(__func__)->            \
-        set_line(__LINE__)->                \
-        set_extendedFunction(FUNC_NAME)->   \
-        set_hash(LINECRC)->                 \
-        set_class(LOG_CLASS)->              \
-        set_module(LOG_MODULE)->            \
-        format(__VA_ARGS__)->               \
-        PostMessage();
+//! \note The call site check happens before anything is allocated or any argument is evaluated
+#define _log(LOG_LEVEL, ...)                                                    \
+    do                                                                          \
+    {                                                                           \
+        static LogXX::callsite logxx_callsite(__FILE__, __func__, FUNC_NAME,    \
+                                              LOG_CLASS, LOG_MODULE, __LINE__,  \
+                                              LOG_LEVEL, LINECRC);              \
+        LOGXX_CHECK_FORMAT(__VA_ARGS__)                                         \
+        if(logxx_callsite.enabled(LOG_LEVEL))                                   \
+        {                                                                       \
+            LogXX::message::create(logxx_callsite, LOG_LEVEL)->                 \
+                LOGXX_APPLY_FORMAT(__VA_ARGS__)->                               \
+                PostMessage();                                                  \
+        }                                                                       \
+    } while(false)
 
 #define _trace(...) _log(LogXX::LOG_DEBUG,   __VA_ARGS__); //!< Log macro trace level
 #define _info(...)  _log(LogXX::LOG_INFO,    __VA_ARGS__); //!< Log macro info level
@@ -297,4 +843,26 @@ namespace LogXX
 #define _err(...)   _log(LogXX::LOG_ERR,     __VA_ARGS__); //!< Log macro error level
 #define _sev(...)   _log(LogXX::LOG_CRIT,    __VA_ARGS__); //!< Log macro critical level
 
+//! Streaming log macro, `_log_s(LogXX::LOG_INFO) << "value " << value;`
+//! \note Like `_log`, nothing is allocated and nothing after the macro is evaluated when the call site is disabled.
+//!       The macro has to be a single statement, so its call site is a static declared in a `for`, each expansion
+//!       gets its own, and the level may be chosen at run time.
+#define _log_s(LOG_LEVEL)                                                                   \
+    for(bool logxx_once(true); logxx_once; logxx_once = false)                              \
+        for(static LogXX::callsite logxx_callsite(__FILE__, __func__, FUNC_NAME,            \
+                                                  LOG_CLASS, LOG_MODULE, __LINE__,          \
+                                                  LOG_LEVEL, LINECRC);                      \
+            logxx_once && logxx_callsite.enabled(LOG_LEVEL);                                \
+            logxx_once = false)                                                             \
+            for(LogXX::messageStream logxx_stream(&logxx_callsite, LOG_LEVEL);              \
+                logxx_stream.pending();                                                     \
+                logxx_stream.post())                                                        \
+                logxx_stream
+
+#define _trace_s _log_s(LogXX::LOG_DEBUG)   //!< Streaming log macro trace level
+#define _info_s  _log_s(LogXX::LOG_INFO)    //!< Streaming log macro info level
+#define _warn_s  _log_s(LogXX::LOG_WARNING) //!< Streaming log macro warning level
+#define _err_s   _log_s(LogXX::LOG_ERR)     //!< Streaming log macro error level
+#define _sev_s   _log_s(LogXX::LOG_CRIT)    //!< Streaming log macro critical level
+
 #endif//_LOG_H_
\ No newline at end of file
@@ -0,0 +1,113 @@
+/**
+ * @file   log_pool.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Recycling allocators for log messages.
+ * @details Free lists that let the log thread hand memory back to producers instead of returning it to the heap
+ */
+
+#pragma once
+#ifndef _LOG_POOL_H_
+#define _LOG_POOL_H_
+
+#include <new>
+#include <memory>
+#include <cstddef>
+
+#include "log_queue.h"
+
+namespace LogXX
+{
+    //! Free list of fixed size memory blocks
+    //! \note Blocks are usually taken by producer threads and returned by the log thread, the free list is a lock free ring
+    //!       so neither side has to wait for the other. A pool is never destroyed, blocks may be returned from static
+    //!       destructors after main() has exited.
+    template <size_t Size, size_t Align>
+    class blockPool
+    {
+        public:
+            //! Get a block, from the free list if possible
+            static void *allocate()
+            {
+                void *block;
+
+                if(freeList().pop(block))
+                {
+                    return block;
+                }
+
+                return ::operator new(Size);
+            }
+
+            //! Return a block to the free list, or to the heap if the free list is full
+            static void deallocate(void *block)
+            {
+                if(!freeList().push(std::move(block)))
+                {
+                    ::operator delete(block);
+                }
+            }
+
+        private:
+            static_assert(Align <= alignof(std::max_align_t), "over aligned blocks are not supported");
+
+            static boundedQueue<void *> &freeList()
+            {
+                static auto *blocks(new boundedQueue<void *>(4096));
+                return *blocks;
+            }
+    };
+
+    //! Standard allocator that recycles single objects through a blockPool
+    //! \note Used for the `std::shared_ptr` control blocks of log messages
+    template <typename T>
+    class poolAllocator
+    {
+        public:
+            using value_type = T;
+
+            poolAllocator() = default;
+
+            template <typename U>
+            poolAllocator(const poolAllocator<U> &)
+            {
+            }
+
+            T *allocate(size_t count)
+            {
+                if(count == 1)
+                {
+                    return static_cast<T *>(blockPool<sizeof(T), alignof(T)>::allocate());
+                }
+
+                return static_cast<T *>(::operator new(count * sizeof(T)));
+            }
+
+            void deallocate(T *ptr, size_t count)
+            {
+                if(count == 1)
+                {
+                    blockPool<sizeof(T), alignof(T)>::deallocate(ptr);
+                }
+                else
+                {
+                    ::operator delete(ptr);
+                }
+            }
+
+            template <typename U>
+            bool operator==(const poolAllocator<U> &) const
+            {
+                return true;
+            }
+
+            template <typename U>
+            bool operator!=(const poolAllocator<U> &) const
+            {
+                return false;
+            }
+    };
+}
+
+#endif//_LOG_POOL_H_
@@ -0,0 +1,168 @@
+/**
+ * @file   log_queue.h
+ * @author Gordon "Lee" Morgan (valk.erie.fod.der+logxx@gmail.com)
+ * @copyright Copyright © Gordon "Lee" Morgan May 2016. This project is released under the [MIT License](license.md)
+ * @date   May 2016
+ * @brief  Bounded lock free message queue.
+ * @details A fixed size ring used to hand log messages from any number of threads to the log manager without taking a lock
+ */
+
+#pragma once
+#ifndef _LOG_QUEUE_H_
+#define _LOG_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace LogXX
+{
+    //! Bounded multi-producer/multi-consumer ring
+    //! \note Based on Dmitry Vyukov's bounded MPMC queue, every cell carries a sequence number so producers and consumers
+    //!       only contend on the cell they are claiming. The manager is the only regular consumer, but keeping the
+    //!       consumer side safe for concurrent use lets the ring double as a free list.
+    template <typename T>
+    class boundedQueue
+    {
+        public:
+            //! Create a ring that holds at least `capacity` elements, rounded up to a power of two
+            explicit boundedQueue(size_t capacity)
+                : m_mask(roundUp(capacity) - 1)
+                , m_cells(new cell[m_mask + 1])
+                , m_enqueuePos(0)
+                , m_dequeuePos(0)
+            {
+                for(size_t i = 0; i <= m_mask; ++i)
+                {
+                    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            boundedQueue(const boundedQueue &) = delete;
+            boundedQueue &operator=(const boundedQueue &) = delete;
+
+            //! Add an element to the ring
+            //! \return false if the ring is full, `value` is left untouched in that case
+            bool push(T &&value)
+            {
+                cell *target;
+                size_t pos(m_enqueuePos.load(std::memory_order_relaxed));
+
+                for(;;)
+                {
+                    target = &m_cells[pos & m_mask];
+                    size_t seq(target->sequence.load(std::memory_order_acquire));
+                    intptr_t diff(static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos));
+
+                    if(diff == 0)
+                    {
+                        if(m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if(diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = m_enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                target->value = std::move(value);
+                target->sequence.store(pos + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            //! Remove the oldest element from the ring
+            //! \return false if the ring is empty
+            bool pop(T &value)
+            {
+                cell *target;
+                size_t pos(m_dequeuePos.load(std::memory_order_relaxed));
+
+                for(;;)
+                {
+                    target = &m_cells[pos & m_mask];
+                    size_t seq(target->sequence.load(std::memory_order_acquire));
+                    intptr_t diff(static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1));
+
+                    if(diff == 0)
+                    {
+                        if(m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if(diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = m_dequeuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                value = std::move(target->value);
+                target->value = T();
+                target->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            //! Number of elements the ring can hold
+            size_t capacity() const
+            {
+                return m_mask + 1;
+            }
+
+            //! Approximate number of queued elements, only exact when no other thread is using the ring
+            size_t size() const
+            {
+                size_t enqueued(m_enqueuePos.load(std::memory_order_relaxed));
+                size_t dequeued(m_dequeuePos.load(std::memory_order_relaxed));
+
+                return enqueued > dequeued ? enqueued - dequeued : 0;
+            }
+
+        private:
+            //! A single slot in the ring
+            struct cell
+            {
+                std::atomic<size_t> sequence;
+                T                   value;
+            };
+
+            //! Round up to the next power of two
+            static size_t roundUp(size_t value)
+            {
+                size_t result(2);
+
+                while(result < value)
+                {
+                    result <<= 1;
+                }
+
+                return result;
+            }
+
+            // Keep the producer and consumer cursors on separate cache lines
+            static constexpr size_t cacheLine = 64;
+
+            const size_t                m_mask;
+            std::unique_ptr<cell[]>     m_cells;
+            char                        m_pad0[cacheLine];
+            std::atomic<size_t>         m_enqueuePos;
+            char                        m_pad1[cacheLine - sizeof(std::atomic<size_t>)];
+            std::atomic<size_t>         m_dequeuePos;
+            char                        m_pad2[cacheLine - sizeof(std::atomic<size_t>)];
+    };
+}
+
+#endif//_LOG_QUEUE_H_
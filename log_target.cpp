@@ -18,5 +18,1857 @@
 #include <condition_variable>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <regex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
-#include "log_target.h"
\ No newline at end of file
+#include "log_target.h"
+#include "log_binary.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace LogXX
+{
+    namespace
+    {
+#ifdef _WIN32
+        int openLog(const boost::filesystem::path &logFile, bool truncate = true)
+        {
+            return ::_wopen(logFile.c_str(), _O_WRONLY | _O_CREAT | (truncate ? _O_TRUNC : _O_APPEND) | _O_TEXT,
+                            _S_IREAD | _S_IWRITE);
+        }
+
+        void closeLog(int fd)
+        {
+            ::_close(fd);
+        }
+
+        bool writeAll(int fd, const char *data, size_t length)
+        {
+            while(length > 0)
+            {
+                int written(::_write(fd, data, static_cast<unsigned>(std::min<size_t>(length, INT_MAX))));
+
+                if(written < 0)
+                {
+                    return false;
+                }
+
+                data += written;
+                length -= written;
+            }
+
+            return true;
+        }
+#else
+        int openLog(const boost::filesystem::path &logFile, bool truncate = true)
+        {
+            return ::open(logFile.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND) | O_CLOEXEC, 0644);
+        }
+
+        void closeLog(int fd)
+        {
+            ::close(fd);
+        }
+
+        //! Write a whole block, retrying short and interrupted writes
+        bool writeAll(int fd, const char *data, size_t length)
+        {
+            while(length > 0)
+            {
+                ssize_t written(::write(fd, data, length));
+
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    return false;
+                }
+
+                data += written;
+                length -= written;
+            }
+
+            return true;
+        }
+#endif
+
+#ifdef __linux__
+        //! Write a whole block at an offset, retrying short and interrupted writes
+        bool pwriteAll(int fd, const char *data, size_t length, uint64_t offset)
+        {
+            while(length > 0)
+            {
+                ssize_t written(::pwrite(fd, data, length, static_cast<off_t>(offset)));
+
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    return false;
+                }
+
+                data += written;
+                length -= written;
+                offset += written;
+            }
+
+            return true;
+        }
+
+        //! Alignment and size granularity of `O_DIRECT` writes, a multiple of any logical block size in use
+        const size_t directBlock = 4096;
+#endif
+
+        //! Drop the calling thread to the lowest CPU and I/O priority the platform offers
+        void lowerPriority()
+        {
+#if defined(_WIN32)
+            ::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+            // Both are per thread on Linux, given the thread ID or 0 for the calling thread
+            ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), 19);
+            ::syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif
+        }
+
+        //! `time` in UTC as `YYYYmmdd-HHMMSS`
+        std::string segmentStamp(std::chrono::system_clock::time_point time)
+        {
+            std::time_t seconds(std::chrono::system_clock::to_time_t(time));
+            std::tm utc;
+#ifdef _WIN32
+            ::gmtime_s(&utc, &seconds);
+#else
+            ::gmtime_r(&seconds, &utc);
+#endif
+            char text[32];
+            return std::string(text, std::strftime(text, sizeof(text), "%Y%m%d-%H%M%S", &utc));
+        }
+
+        //! First multiple of `interval` since the epoch after `time`
+        std::chrono::system_clock::time_point nextBoundary(std::chrono::system_clock::time_point time,
+                                                           std::chrono::seconds interval)
+        {
+            auto elapsed(std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()));
+
+            return std::chrono::system_clock::time_point((elapsed / interval + 1) * interval);
+        }
+
+        //! Read a `backend` node value as a number with an optional unit suffix
+        //! \param[in] units suffix characters, lower case, and what each one multiplies by
+        uintmax_t backendNumber(const boost::property_tree::ptree &backend, const std::string &key,
+                                std::initializer_list<std::pair<char, uintmax_t>> units)
+        {
+            auto text(backend.get<std::string>(key, ""));
+
+            if(text.empty())
+            {
+                return 0;
+            }
+
+            size_t end(0);
+            uintmax_t value(0);
+
+            try
+            {
+                value = std::stoull(text, &end);
+            }
+            catch(const std::exception &)
+            {
+                throw std::invalid_argument("log backend " + key + " is not a number: " + text);
+            }
+
+            if(end == text.size())
+            {
+                return value;
+            }
+
+            if(end + 1 == text.size())
+            {
+                for(const auto &unit : units)
+                {
+                    if(std::tolower(static_cast<unsigned char>(text[end])) == unit.first)
+                    {
+                        return value * unit.second;
+                    }
+                }
+            }
+
+            throw std::invalid_argument("log backend " + key + " has an unknown unit: " + text);
+        }
+
+        boost::filesystem::path backendFile(const boost::property_tree::ptree &backend)
+        {
+            auto file(backend.get<std::string>("file", ""));
+
+            if(file.empty())
+            {
+                throw std::invalid_argument("log backend has no file");
+            }
+
+            return file;
+        }
+
+        logFile::rotationPolicy backendRotation(const boost::property_tree::ptree &backend)
+        {
+            logFile::rotationPolicy rotation;
+
+            rotation.maxSize = backendNumber(backend, "rotate_size", {{'k', 1024}, {'m', 1024 * 1024}, {'g', 1024 * 1024 * 1024}});
+            rotation.interval = std::chrono::seconds(backendNumber(backend, "rotate_interval", {{'s', 1}, {'m', 60}, {'h', 3600}, {'d', 86400}}));
+            rotation.keep = static_cast<unsigned>(backendNumber(backend, "keep", {}));
+
+            auto compress(backend.get<std::string>("compress", "false"));
+
+            if(boost::algorithm::iequals(compress, "true") || compress == "1")
+            {
+                rotation.compress = true;
+            }
+            else if(!boost::algorithm::iequals(compress, "false") && compress != "0")
+            {
+                throw std::invalid_argument("log backend compress is not true or false: " + compress);
+            }
+
+            return rotation;
+        }
+    }
+
+    //! Compresses and prunes the closed files of one log file, on a thread of its own
+    //! \details Files are compressed to `.gz.part` and renamed when complete, so a closed file always exists under one of
+    //!          its two names. Shutdown abandons the file being compressed and leaves the rest, the next run picks up
+    //!          whatever is left uncompressed. Problems leave the closed file as it is, there is nobody to report them to.
+    class logFile::archiver
+    {
+        public:
+            archiver(const boost::filesystem::path &logFile, const rotationPolicy &rotation)
+                : m_directory(logFile.has_parent_path() ? logFile.parent_path() : boost::filesystem::path("."))
+                , m_prefix(logFile.filename().string() + ".")
+                , m_rotation(rotation)
+                , m_stop(false)
+                , m_thread(&archiver::run, this)
+            {
+            }
+
+            ~archiver()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop.store(true);
+                }
+
+                m_wake.notify_one();
+                m_thread.join();
+            }
+
+            //! Queue a closed file
+            void add(const boost::filesystem::path &segment)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_pending.push_back(segment);
+                }
+
+                m_wake.notify_one();
+            }
+
+        private:
+            //! A closed file
+            struct segment
+            {
+                boost::filesystem::path path;
+                std::string             stamp;
+                unsigned                index;
+                bool                    compressed;
+                bool                    partial;        //!< compression that never finished
+            };
+
+            void run()
+            {
+                lowerPriority();
+
+                // Finish off anything an earlier run left behind
+                for(const auto &closed : segments())
+                {
+                    boost::system::error_code error;
+
+                    if(m_stop.load())
+                    {
+                        return;
+                    }
+
+                    if(closed.partial)
+                    {
+                        boost::filesystem::remove(closed.path, error);
+                    }
+                    else if(m_rotation.compress && !closed.compressed)
+                    {
+                        compress(closed.path);
+                    }
+                }
+
+                prune();
+
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                while(true)
+                {
+                    m_wake.wait(lock, [this]{ return m_stop.load() || !m_pending.empty(); });
+
+                    if(m_stop.load())
+                    {
+                        break;
+                    }
+
+                    auto closed(m_pending.front());
+                    m_pending.pop_front();
+                    lock.unlock();
+
+                    if(m_rotation.compress)
+                    {
+                        compress(closed);
+                    }
+
+                    prune();
+                    lock.lock();
+                }
+            }
+
+            //! Closed files of this log, oldest first
+            std::vector<segment> segments() const
+            {
+                static const std::regex name(R"((\d{8}-\d{6})(?:\.(\d+))?(\.gz)?(\.part)?)");
+                std::vector<segment> found;
+                boost::system::error_code error;
+
+                for(boost::filesystem::directory_iterator entry(m_directory, error), end; !error && entry != end; entry.increment(error))
+                {
+                    auto file(entry->path().filename().string());
+                    std::smatch match;
+
+                    if(file.compare(0, m_prefix.size(), m_prefix) != 0)
+                    {
+                        continue;
+                    }
+
+                    auto rest(file.substr(m_prefix.size()));
+
+                    if(std::regex_match(rest, match, name) && (match[3].matched || !match[4].matched))
+                    {
+                        found.push_back({entry->path(), match[1].str(),
+                                         match[2].matched ? static_cast<unsigned>(std::stoul(match[2].str())) : 0u,
+                                         match[3].matched, match[4].matched});
+                    }
+                }
+
+                std::sort(found.begin(), found.end(), [](const segment &a, const segment &b)
+                {
+                    return std::tie(a.stamp, a.index) < std::tie(b.stamp, b.index);
+                });
+
+                return found;
+            }
+
+            //! gzip a closed file and delete the original
+            void compress(const boost::filesystem::path &closed)
+            {
+                boost::system::error_code error;
+
+                if(!boost::filesystem::exists(closed, error))
+                {
+                    return;
+                }
+
+                boost::filesystem::path compressed(closed.string() + ".gz");
+                boost::filesystem::path partial(compressed.string() + ".part");
+                bool complete(false);
+
+                try
+                {
+                    boost::filesystem::ifstream in(closed, std::ios::binary);
+                    boost::filesystem::ofstream out(partial, std::ios::binary | std::ios::trunc);
+
+                    if(in && out)
+                    {
+                        boost::iostreams::filtering_ostream gzip;
+                        gzip.push(boost::iostreams::gzip_compressor());
+                        gzip.push(out);
+
+                        // A block at a time, so shutdown doesn't have to wait for a whole file
+                        std::vector<char> block(64 * 1024);
+
+                        while(!m_stop.load() && in.read(block.data(), block.size()).gcount() > 0)
+                        {
+                            gzip.write(block.data(), in.gcount());
+                        }
+
+                        complete = !m_stop.load() && !in.bad();
+                        gzip.reset();
+                        out.close();
+                        complete = complete && !out.fail();
+                    }
+                }
+                catch(const std::exception &)
+                {
+                    complete = false;
+                }
+
+                if(complete)
+                {
+                    boost::filesystem::rename(partial, compressed, error);
+                    complete = !error;
+                }
+
+                if(complete)
+                {
+                    boost::filesystem::remove(closed, error);
+                }
+                else
+                {
+                    boost::filesystem::remove(partial, error);
+                }
+            }
+
+            //! Delete the oldest closed files beyond the number to keep
+            void prune()
+            {
+                if(m_rotation.keep == 0)
+                {
+                    return;
+                }
+
+                auto closed(segments());
+                boost::system::error_code error;
+
+                closed.erase(std::remove_if(closed.begin(), closed.end(), [](const segment &s) { return s.partial; }), closed.end());
+
+                for(size_t i = 0; i + m_rotation.keep < closed.size(); ++i)
+                {
+                    boost::filesystem::remove(closed[i].path, error);
+                }
+            }
+
+            boost::filesystem::path                 m_directory;
+            std::string                             m_prefix;       //!< log file name and a dot, closed files start with it
+            rotationPolicy                          m_rotation;
+            std::mutex                              m_mutex;
+            std::condition_variable                 m_wake;
+            std::deque<boost::filesystem::path>     m_pending;      //!< closed files waiting to be compressed
+            std::atomic<bool>                       m_stop;
+            std::thread                             m_thread;
+    };
+
+    logFile::logFile(const boost::filesystem::path filePath)
+        : logFile(filePath, flushPolicy())
+    {
+    }
+
+    logFile::logFile(const boost::filesystem::path filePath, const flushPolicy &policy)
+        : logFile(filePath, policy, rotationPolicy())
+    {
+    }
+
+    logFile::logFile(const boost::filesystem::path filePath, const flushPolicy &policy, const rotationPolicy &rotation)
+        : m_fd(-1)
+        , m_policy(policy)
+        , m_appender(m_buffer)
+        , m_stream(&m_appender)
+        , m_path(filePath)
+        , m_rotation(rotation)
+        , m_written(0)
+    {
+        m_buffer.reserve(m_policy.bufferSize + 1024);
+
+        bool truncate(true);
+
+        if(m_rotation.maxSize != 0 || m_rotation.interval.count() != 0 || m_rotation.keep != 0 || m_rotation.compress)
+        {
+            m_archiver = std::make_unique<archiver>(m_path, m_rotation);
+
+            // Treat a file left by an earlier run as closed, rather than truncating it
+            boost::system::error_code error;
+            auto size(boost::filesystem::file_size(m_path, error));
+
+            if(!error && size > 0)
+            {
+                auto closed(closeSegment());
+
+                if(!closed.empty())
+                {
+                    m_archiver->add(closed);
+                }
+
+                // Couldn't be moved, add to it like rotate() does
+                truncate = !closed.empty();
+            }
+
+            if(m_rotation.interval.count() != 0)
+            {
+                m_nextRotation = nextBoundary(std::chrono::system_clock::now(), m_rotation.interval);
+            }
+        }
+
+        m_fd = openLog(m_path, truncate);
+    }
+
+    logFile::logFile(const boost::property_tree::ptree &backend)
+        : logFile(backendFile(backend), flushPolicy(), backendRotation(backend))
+    {
+    }
+
+    logFile::~logFile()
+    {
+        Flush();
+
+        if(m_fd >= 0)
+        {
+            closeLog(m_fd);
+        }
+    }
+
+    void logFile::LogMessage(std::shared_ptr<message> msg)
+    {
+        if(m_fd < 0)
+        {
+            return;
+        }
+
+        if(m_buffer.empty())
+        {
+            m_oldest = std::chrono::steady_clock::now();
+        }
+
+        append(*msg);
+
+        if(m_buffer.size() > m_policy.bufferSize || msg->getLevel() <= m_policy.immediateLevel)
+        {
+            Flush();
+        }
+    }
+
+    void logFile::LogMessages(const std::vector<std::shared_ptr<message>> &messages)
+    {
+        if(m_fd < 0 || messages.empty())
+        {
+            return;
+        }
+
+        if(m_buffer.empty())
+        {
+            m_oldest = std::chrono::steady_clock::now();
+        }
+
+        // Format the whole batch, then decide once whether it has to be written. A big batch is written a buffer at a
+        // time, so the buffer doesn't grow without bound and rotated files stay close to their size limit.
+        bool immediate(false);
+
+        for(const auto &msg : messages)
+        {
+            append(*msg);
+            immediate |= msg->getLevel() <= m_policy.immediateLevel;
+
+            if(m_buffer.size() > m_policy.bufferSize)
+            {
+                Flush();
+                m_oldest = std::chrono::steady_clock::now();
+            }
+        }
+
+        if(immediate)
+        {
+            Flush();
+        }
+    }
+
+    void logFile::append(const message &msg)
+    {
+        m_header.render(msg, m_buffer);
+        m_buffer.push_back(' ');
+        m_stream << msg.getMessageBody() << '\n';
+    }
+
+    void logFile::Idle()
+    {
+        if(!m_buffer.empty() && std::chrono::steady_clock::now() - m_oldest >= m_policy.interval)
+        {
+            Flush();
+        }
+        else if(m_buffer.empty() && m_fd >= 0 && m_rotation.interval.count() != 0 && rotationDue(0))
+        {
+            // Close the file on its time boundary even when nothing more is being logged
+            rotate();
+        }
+    }
+
+    void logFile::Flush()
+    {
+        if(m_fd >= 0 && !m_buffer.empty())
+        {
+            if(rotationDue(m_buffer.size()))
+            {
+                rotate();
+            }
+
+            if(m_fd >= 0 && writeAll(m_fd, m_buffer.data(), m_buffer.size()))
+            {
+                m_written += m_buffer.size();
+            }
+        }
+
+        m_buffer.clear();
+    }
+
+    bool logFile::rotationDue(size_t pending)
+    {
+        if(!m_archiver)
+        {
+            return false;
+        }
+
+        if(m_rotation.interval.count() != 0)
+        {
+            auto now(std::chrono::system_clock::now());
+
+            if(now >= m_nextRotation)
+            {
+                if(m_written != 0)
+                {
+                    return true;
+                }
+
+                // Nothing was written this time around, carry on with the same file
+                m_nextRotation = nextBoundary(now, m_rotation.interval);
+            }
+        }
+
+        return m_written != 0 && m_rotation.maxSize != 0 && m_written + pending > m_rotation.maxSize;
+    }
+
+    void logFile::rotate()
+    {
+        closeLog(m_fd);
+
+        auto closed(closeSegment());
+
+        // If the file couldn't be moved keep adding to it, and try again once another maxSize or interval has gone by
+        m_fd = openLog(m_path, !closed.empty());
+        m_written = 0;
+
+        if(m_rotation.interval.count() != 0)
+        {
+            m_nextRotation = nextBoundary(std::chrono::system_clock::now(), m_rotation.interval);
+        }
+
+        if(!closed.empty())
+        {
+            m_archiver->add(closed);
+        }
+    }
+
+    boost::filesystem::path logFile::closeSegment()
+    {
+        std::string base(m_path.string() + "." + segmentStamp(std::chrono::system_clock::now()));
+        std::string prefix(boost::filesystem::path(base).filename().string());
+        boost::filesystem::path closed(base);
+        boost::system::error_code error;
+        unsigned next(0);
+
+        // Several files closed within a second, number them after the newest one so far, whatever has been pruned or
+        // compressed since, or the new file would sort as one of the oldest
+        auto directory(closed.has_parent_path() ? closed.parent_path() : boost::filesystem::path("."));
+
+        for(boost::filesystem::directory_iterator entry(directory, error), end; !error && entry != end; entry.increment(error))
+        {
+            auto file(entry->path().filename().string());
+
+            if(file.compare(0, prefix.size(), prefix) != 0)
+            {
+                continue;
+            }
+
+            unsigned index(0);
+
+            if(file.size() == prefix.size() || file[prefix.size()] != '.' ||
+               std::sscanf(file.c_str() + prefix.size(), ".%u", &index) != 1)
+            {
+                // The first file of the second, maybe compressed
+                index = 0;
+            }
+
+            next = std::max(next, index + 1);
+        }
+
+        if(next != 0)
+        {
+            closed = base + "." + std::to_string(next);
+        }
+
+        boost::filesystem::rename(m_path, closed, error);
+
+        return error ? boost::filesystem::path() : closed;
+    }
+
+    logBinary::logBinary(const boost::filesystem::path logFile) : m_file(logFile, std::ios::binary | std::ios::trunc)
+    {
+        if(m_file.is_open())
+        {
+            m_record.append(binary::magic, sizeof(binary::magic));
+            binary::append(m_record, binary::version);
+            binary::append(m_record, static_cast<int64_t>(std::chrono::system_clock::period::num));
+            binary::append(m_record, static_cast<int64_t>(std::chrono::system_clock::period::den));
+            m_file.write(m_record.data(), m_record.size());
+        }
+    }
+
+    void logBinary::LogMessage(std::shared_ptr<message> msg)
+    {
+        if(!m_file.is_open())
+        {
+            return;
+        }
+
+        m_record.clear();
+        appendRecord(msg);
+        m_file.write(m_record.data(), m_record.size());
+    }
+
+    void logBinary::LogMessages(const std::vector<std::shared_ptr<message>> &messages)
+    {
+        if(!m_file.is_open())
+        {
+            return;
+        }
+
+        m_record.clear();
+
+        for(const auto &msg : messages)
+        {
+            appendRecord(msg);
+        }
+
+        m_file.write(m_record.data(), m_record.size());
+    }
+
+    void logBinary::appendRecord(const std::shared_ptr<message> &msg)
+    {
+        const auto &site(msg->getCallsite());
+
+        if(m_callsites.insert(site.getHash()).second)
+        {
+            binary::append(m_record, binary::TAG_CALLSITE);
+            binary::append(m_record, site.getHash());
+            binary::append(m_record, site.getLine());
+            binary::append(m_record, static_cast<uint8_t>(site.getLevel()));
+            binary::appendString(m_record, site.getFile());
+            binary::appendString(m_record, site.getFunction());
+            binary::appendString(m_record, site.getExtendedFunction());
+            binary::appendString(m_record, site.getClass());
+            binary::appendString(m_record, site.getModule());
+        }
+
+        auto thread(m_threads.find(msg->getThreadID()));
+
+        if(thread == m_threads.end())
+        {
+            std::stringstream threadText;
+            threadText << msg->getThreadID();
+
+            thread = m_threads.insert({msg->getThreadID(), static_cast<uint32_t>(m_threads.size())}).first;
+            binary::append(m_record, binary::TAG_THREAD);
+            binary::append(m_record, thread->second);
+            binary::appendString(m_record, threadText.str());
+        }
+
+        binary::append(m_record, binary::TAG_MESSAGE);
+        binary::append(m_record, site.getHash());
+        binary::append(m_record, static_cast<int64_t>(msg->getDate().time_since_epoch().count()));
+        binary::append(m_record, thread->second);
+        binary::append(m_record, static_cast<uint8_t>(msg->getLevel()));
+        binary::appendString(m_record, msg->getMessageBody().str());
+    }
+
+#ifndef _WIN32
+    //! Layout of the start of a ring file, the ring data follows at `dataOffset`
+    struct logRing::ringHeader
+    {
+        char                    magic[4];
+        uint32_t                version;
+        uint64_t                capacity;
+        std::atomic<uint64_t>   head;       //!< ring position after the newest record
+        std::atomic<uint64_t>   tail;       //!< ring position of the oldest record
+    };
+
+    //! Fixed part of a ring record, followed by the text of the message
+    struct logRing::recordHeader
+    {
+        uint32_t    length;                         //!< total record length, including this header
+        uint32_t    textLength;                     //!< length of the text, header + ' ' + body + '\n'
+        uint32_t    bodyOffset;                     //!< offset of the message body within the text
+        uint32_t    level;
+        uint64_t    site;                           //!< address of the call site, only valid in the writing process
+        int64_t     ticks;                          //!< system_clock ticks since the epoch
+        char        thread[sizeof(std::thread::id)];
+    };
+
+    static const char     ringMagic[4] = {'L', 'X', 'X', 'R'};
+    static const uint32_t ringVersion  = 1;
+    static const size_t   dataOffset   = 64;
+    static const size_t   minCapacity  = 4096;  //!< a quarter of it, the most one record may take, still fits a header and a line
+
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "ring positions must be plain 64 bit words");
+
+    logRing::logRing(const boost::filesystem::path &ringFile, size_t capacity)
+        : m_fd(::open(ringFile.c_str(), O_RDWR | O_CREAT, 0644))
+        , m_mapSize(dataOffset + std::max(capacity, minCapacity))
+        , m_ring(nullptr)
+        , m_data(nullptr)
+        , m_capacity(m_mapSize - dataOffset)
+    {
+        static_assert(sizeof(ringHeader) <= dataOffset, "ring header overlaps ring data");
+
+        if(m_fd < 0)
+        {
+            return;
+        }
+
+        // Save whatever a previous run left behind before we start overwriting it
+        struct stat status;
+
+        if(::fstat(m_fd, &status) == 0 && static_cast<size_t>(status.st_size) > dataOffset)
+        {
+            void *previous(::mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0));
+
+            if(previous != MAP_FAILED)
+            {
+                m_ring = static_cast<ringHeader *>(previous);
+                m_data = static_cast<char *>(previous) + dataOffset;
+                m_capacity = m_ring->capacity;
+
+                // Anything in the file may be damaged, a capacity of 0 would divide by zero in Dump()
+                if(std::memcmp(m_ring->magic, ringMagic, sizeof(ringMagic)) == 0 && m_ring->version == ringVersion &&
+                   m_capacity >= minCapacity && m_capacity <= static_cast<size_t>(status.st_size) - dataOffset &&
+                   m_ring->head > m_ring->tail)
+                {
+                    auto lastFile(ringFile.string() + ".last");
+                    int lastFd(::open(lastFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+
+                    if(lastFd >= 0)
+                    {
+                        Dump(lastFd);
+                        ::close(lastFd);
+                    }
+                }
+
+                ::munmap(previous, status.st_size);
+            }
+        }
+
+        m_ring = nullptr;
+        m_data = nullptr;
+        m_capacity = m_mapSize - dataOffset;
+
+        if(::ftruncate(m_fd, m_mapSize) != 0)
+        {
+            return;
+        }
+
+        void *ring(::mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0));
+
+        if(ring != MAP_FAILED)
+        {
+            m_ring = static_cast<ringHeader *>(ring);
+            m_data = static_cast<char *>(ring) + dataOffset;
+
+            std::memcpy(m_ring->magic, ringMagic, sizeof(ringMagic));
+            m_ring->version = ringVersion;
+            m_ring->capacity = m_capacity;
+            m_ring->head.store(0);
+            m_ring->tail.store(0);
+        }
+    }
+
+    logRing::~logRing()
+    {
+        if(m_ring)
+        {
+            ::munmap(m_ring, m_mapSize);
+        }
+
+        if(m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    void logRing::copyIn(uint64_t position, const void *data, size_t length)
+    {
+        size_t offset(position % m_capacity);
+        size_t first(std::min<size_t>(length, m_capacity - offset));
+
+        std::memcpy(m_data + offset, data, first);
+        std::memcpy(m_data, static_cast<const char *>(data) + first, length - first);
+    }
+
+    void logRing::copyOut(uint64_t position, void *data, size_t length) const
+    {
+        size_t offset(position % m_capacity);
+        size_t first(std::min<size_t>(length, m_capacity - offset));
+
+        std::memcpy(data, m_data + offset, first);
+        std::memcpy(static_cast<char *>(data) + first, m_data, length - first);
+    }
+
+    void logRing::LogMessage(std::shared_ptr<message> msg)
+    {
+        if(!m_ring)
+        {
+            return;
+        }
+
+        //! Text of a record, rendered by each thread for itself
+        struct recordText
+        {
+            std::string  text;
+            appendBuffer appender;
+            std::ostream stream;
+
+            recordText() : appender(text), stream(&appender) {}
+        };
+
+        thread_local recordText rendered;
+        std::string &text(rendered.text);
+
+        text.clear();
+        m_header.render(*msg, text);
+        text.push_back(' ');
+        uint32_t bodyOffset(static_cast<uint32_t>(text.size()));
+        rendered.stream << msg->getMessageBody() << '\n';
+
+        // Keep a single message from taking over the ring
+        size_t maxText(m_capacity / 4 - sizeof(recordHeader));
+
+        if(text.size() > maxText)
+        {
+            text.resize(maxText);
+            text.back() = '\n';
+            bodyOffset = std::min<uint32_t>(bodyOffset, text.size() - 1);
+        }
+
+        recordHeader record;
+        record.length = static_cast<uint32_t>(sizeof(record) + text.size());
+        record.textLength = static_cast<uint32_t>(text.size());
+        record.bodyOffset = bodyOffset;
+        record.level = msg->getLevel();
+        record.site = reinterpret_cast<uintptr_t>(&msg->getCallsite());
+        record.ticks = msg->getDate().time_since_epoch().count();
+        std::memcpy(record.thread, &msg->getThreadID(), sizeof(record.thread));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Drop the oldest records until there is room, then publish the new head last so a crash mid write is harmless
+        uint64_t head(m_ring->head.load(std::memory_order_relaxed));
+        uint64_t tail(m_ring->tail.load(std::memory_order_relaxed));
+
+        while(head + record.length - tail > m_capacity)
+        {
+            uint32_t length;
+            copyOut(tail, &length, sizeof(length));
+            tail += length;
+        }
+
+        m_ring->tail.store(tail, std::memory_order_release);
+        copyIn(head, &record, sizeof(record));
+        copyIn(head + sizeof(record), text.data(), text.size());
+        m_ring->head.store(head + record.length, std::memory_order_release);
+    }
+
+    void logRing::Dump(logTarget &target)
+    {
+        if(!m_ring)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t head(m_ring->head.load(std::memory_order_acquire));
+        std::string text;
+
+        for(uint64_t position(m_ring->tail.load(std::memory_order_acquire)); position < head;)
+        {
+            recordHeader record;
+            copyOut(position, &record, sizeof(record));
+
+            text.resize(record.textLength);
+            copyOut(position + sizeof(record), &text[0], text.size());
+
+            std::thread::id threadID;
+            std::memcpy(&threadID, record.thread, sizeof(threadID));
+
+            auto msg(message::create(*reinterpret_cast<const callsite *>(record.site), static_cast<levels>(record.level)));
+            msg->set_date(std::chrono::system_clock::time_point(std::chrono::system_clock::duration(record.ticks)))
+               ->set_threadID(threadID)
+               ->format("%1%", text.substr(record.bodyOffset, record.textLength - record.bodyOffset - 1));
+
+            target.LogMessage(msg);
+            position += record.length;
+        }
+    }
+
+    void logRing::Dump(int fd) const
+    {
+        if(!m_ring)
+        {
+            return;
+        }
+
+        uint64_t head(m_ring->head.load(std::memory_order_acquire));
+
+        for(uint64_t position(m_ring->tail.load(std::memory_order_acquire)); position < head;)
+        {
+            recordHeader record;
+            copyOut(position, &record, sizeof(record));
+
+            if(record.length < sizeof(record) || record.length > m_capacity)
+            {
+                break; // damaged ring, stop rather than write garbage
+            }
+
+            size_t offset((position + sizeof(record)) % m_capacity);
+            size_t first(std::min<size_t>(record.textLength, m_capacity - offset));
+
+            if(::write(fd, m_data + offset, first) < 0 ||
+               (record.textLength > first && ::write(fd, m_data, record.textLength - first) < 0))
+            {
+                break;
+            }
+
+            position += record.length;
+        }
+    }
+
+    constexpr uint64_t logMappedFile::growStep;
+
+    logMappedFile::logMappedFile(const boost::filesystem::path &logFile, size_t chunkSize, std::chrono::milliseconds syncInterval)
+        : m_fd(::open(logFile.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+        , m_chunkSize(chunkSize)
+        , m_syncInterval(syncInterval)
+        , m_map(nullptr)
+        , m_mapOffset(0)
+        , m_mapSize(0)
+        , m_position(0)
+        , m_synced(0)
+        , m_fileSize(0)
+        , m_reserved(0)
+        , m_page(static_cast<size_t>(::sysconf(_SC_PAGESIZE)))
+        , m_lastSync(std::chrono::steady_clock::now())
+        , m_appender(m_text)
+        , m_stream(&m_appender)
+    {
+        m_chunkSize = std::max((m_chunkSize + m_page - 1) / m_page * m_page, m_page);
+
+        if(m_fd >= 0)
+        {
+            remap(0);
+        }
+    }
+
+    logMappedFile::~logMappedFile()
+    {
+        if(m_map != nullptr)
+        {
+            Flush();
+            ::munmap(m_map, m_mapSize);
+        }
+
+        if(m_fd >= 0)
+        {
+            // Drop the unused end of the last chunk, if that fails the zeros stay
+            if(::ftruncate(m_fd, static_cast<off_t>(m_position)) == 0)
+            {
+                m_fileSize = m_position;
+            }
+
+            ::close(m_fd);
+        }
+    }
+
+    bool logMappedFile::remap(size_t length)
+    {
+        if(m_map != nullptr)
+        {
+            Flush();
+            ::munmap(m_map, m_mapSize);
+            m_map = nullptr;
+        }
+
+        // Mappings start on a page, so the new one starts on the page holding the next message
+        uint64_t offset(m_position / m_page * m_page);
+        size_t size(std::max<size_t>(m_chunkSize, (m_position - offset + length + m_page - 1) / m_page * m_page));
+
+        if(offset + size > m_reserved)
+        {
+#ifdef FALLOC_FL_KEEP_SIZE
+            // Allocate the blocks without moving the end of the file, so growing into them later can't run out of space.
+            // Not every file system can, those carry on without the reservation.
+            if(::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(m_reserved), static_cast<off_t>(offset + size - m_reserved)) != 0 &&
+               errno != EOPNOTSUPP)
+            {
+                return false;
+            }
+#endif
+            m_reserved = offset + size;
+        }
+
+        void *map(::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, static_cast<off_t>(offset)));
+
+        if(map == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_map = static_cast<char *>(map);
+        m_mapOffset = offset;
+        m_mapSize = size;
+        m_synced = std::max(m_synced, offset);
+        return true;
+    }
+
+    void logMappedFile::LogMessage(std::shared_ptr<message> msg)
+    {
+        if(m_map == nullptr)
+        {
+            return;
+        }
+
+        m_text.clear();
+        m_header.render(*msg, m_text);
+        m_text.push_back(' ');
+        m_stream << msg->getMessageBody() << '\n';
+
+        if(m_position + m_text.size() > m_mapOffset + m_mapSize && !remap(m_text.size()))
+        {
+            return;
+        }
+
+        // Touching a page past the end of the file is SIGBUS
+        if(m_position + m_text.size() > m_fileSize && !grow(m_position + m_text.size()))
+        {
+            return;
+        }
+
+        std::memcpy(m_map + (m_position - m_mapOffset), m_text.data(), m_text.size());
+        m_position += m_text.size();
+    }
+
+    bool logMappedFile::grow(uint64_t end)
+    {
+        // Whole steps keep the ftruncate() calls rare, the mapping can only be written up to the end of the file
+        uint64_t size(std::max((end + m_page - 1) / m_page * m_page, std::min((end + growStep - 1) / growStep * growStep, m_reserved)));
+
+        if(::ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+        {
+            return false;
+        }
+
+        m_fileSize = size;
+        return true;
+    }
+
+    void logMappedFile::Idle()
+    {
+        if(m_position > m_synced && std::chrono::steady_clock::now() - m_lastSync >= m_syncInterval)
+        {
+            Flush();
+        }
+    }
+
+    void logMappedFile::Flush()
+    {
+        if(m_map == nullptr || m_position <= m_synced)
+        {
+            return;
+        }
+
+        // From the page holding the first unsynced byte to the newest message, msync() wants a page aligned start
+        uint64_t start(m_synced / m_page * m_page);
+
+        ::msync(m_map + (start - m_mapOffset), m_position - start, MS_ASYNC);
+
+        m_synced = m_position;
+        m_lastSync = std::chrono::steady_clock::now();
+    }
+#endif
+
+#ifdef __linux__
+    //! Carries out the writes of a logAsyncFile
+    class logAsyncFile::engine
+    {
+        public:
+            virtual ~engine() = default;
+
+            //! Start writing `length` bytes of buffer number `buffer` at `offset`
+            virtual void submit(unsigned buffer, const char *data, size_t length, uint64_t offset) = 0;
+
+            //! Add the buffers whose writes have finished to `free`, if `wait` block until there is at least one
+            virtual void complete(bool wait, std::vector<unsigned> &free, uint64_t &errors) = 0;
+    };
+
+    //! Writes through an io_uring, set up with raw system calls
+    //! \details Only the log thread touches the rings. Submissions are made one `io_uring_enter()` at a time, there are
+    //!          never more in flight than there are buffers, so neither ring can fill up.
+    class logAsyncFile::uringEngine : public engine
+    {
+        public:
+            uringEngine(int fd, unsigned entries)
+                : m_fd(fd)
+                , m_ring(-1)
+                , m_sq(MAP_FAILED)
+                , m_cq(MAP_FAILED)
+                , m_sqes(MAP_FAILED)
+                , m_sqSize(0)
+                , m_cqSize(0)
+                , m_sqesSize(0)
+                , m_writes(entries)
+            {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+
+                m_ring = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+
+                if(m_ring < 0)
+                {
+                    return;
+                }
+
+                m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+                bool single((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+
+                if(single)
+                {
+                    m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+                }
+
+                m_sq = ::mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+                m_cq = single ? m_sq : ::mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+                m_sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+
+                if(!valid())
+                {
+                    return;
+                }
+
+                auto sq(static_cast<char *>(m_sq));
+                auto cq(static_cast<char *>(m_cq));
+
+                m_sqTail  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+                m_sqMask  = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+                m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+                m_cqHead  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+                m_cqTail  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+                m_cqMask  = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+                m_cqes    = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            }
+
+            ~uringEngine()
+            {
+                if(m_sqes != MAP_FAILED)
+                {
+                    ::munmap(m_sqes, m_sqesSize);
+                }
+
+                if(m_cq != MAP_FAILED && m_cq != m_sq)
+                {
+                    ::munmap(m_cq, m_cqSize);
+                }
+
+                if(m_sq != MAP_FAILED)
+                {
+                    ::munmap(m_sq, m_sqSize);
+                }
+
+                if(m_ring >= 0)
+                {
+                    ::close(m_ring);
+                }
+            }
+
+            //! False if the kernel doesn't have io_uring, or won't let us use it
+            bool valid() const
+            {
+                return m_ring >= 0 && m_sq != MAP_FAILED && m_cq != MAP_FAILED && m_sqes != MAP_FAILED;
+            }
+
+            void submit(unsigned buffer, const char *data, size_t length, uint64_t offset) override
+            {
+                auto &write(m_writes[buffer]);
+                write.vector.iov_base = const_cast<char *>(data);
+                write.vector.iov_len = length;
+                write.offset = offset;
+
+                // Vectored write, it has been there since the first io_uring kernels
+                unsigned tail(*m_sqTail);
+                unsigned index(tail & m_sqMask);
+                auto &entry(static_cast<io_uring_sqe *>(m_sqes)[index]);
+
+                std::memset(&entry, 0, sizeof(entry));
+                entry.opcode = IORING_OP_WRITEV;
+                entry.fd = m_fd;
+                entry.addr = reinterpret_cast<uint64_t>(&write.vector);
+                entry.len = 1;
+                entry.off = offset;
+                entry.user_data = buffer;
+
+                m_sqArray[index] = index;
+                __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+                if(enter(1, 0, 0) < 0)
+                {
+                    // The kernel only looks at the ring inside io_uring_enter(), so the entry can be taken back and the
+                    // write done here instead
+                    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+                    m_finished.push_back({buffer, pwriteAll(m_fd, data, length, offset)});
+                }
+            }
+
+            void complete(bool wait, std::vector<unsigned> &free, uint64_t &errors) override
+            {
+                unsigned head(*m_cqHead);
+
+                if(wait && m_finished.empty() && head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+                {
+                    enter(0, 1, IORING_ENTER_GETEVENTS);
+                }
+
+                for(unsigned tail(__atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)); head != tail; ++head)
+                {
+                    const auto &result(m_cqes[head & m_cqMask]);
+                    auto buffer(static_cast<unsigned>(result.user_data));
+                    const auto &write(m_writes[buffer]);
+
+                    if(result.res < 0)
+                    {
+                        ++errors;
+                    }
+                    else if(static_cast<size_t>(result.res) < write.vector.iov_len)
+                    {
+                        // Short write, finish it off here
+                        if(!pwriteAll(m_fd, static_cast<const char *>(write.vector.iov_base) + result.res,
+                                      write.vector.iov_len - result.res, write.offset + result.res))
+                        {
+                            ++errors;
+                        }
+                    }
+
+                    free.push_back(buffer);
+                }
+
+                __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+                for(const auto &finished : m_finished)
+                {
+                    free.push_back(finished.first);
+                    errors += finished.second ? 0 : 1;
+                }
+
+                m_finished.clear();
+            }
+
+        private:
+            //! A write in flight
+            struct write
+            {
+                iovec       vector;
+                uint64_t    offset;
+            };
+
+            int enter(unsigned submit, unsigned wait, unsigned flags)
+            {
+                int result;
+
+                do
+                {
+                    result = static_cast<int>(::syscall(__NR_io_uring_enter, m_ring, submit, wait, flags, nullptr, 0));
+                }
+                while(result < 0 && errno == EINTR);
+
+                return result;
+            }
+
+            int                                     m_fd;
+            int                                     m_ring;
+            void                                   *m_sq;
+            void                                   *m_cq;
+            void                                   *m_sqes;
+            size_t                                  m_sqSize;
+            size_t                                  m_cqSize;
+            size_t                                  m_sqesSize;
+            unsigned                               *m_sqTail = nullptr;
+            unsigned                                m_sqMask = 0;
+            unsigned                               *m_sqArray = nullptr;
+            unsigned                               *m_cqHead = nullptr;
+            unsigned                               *m_cqTail = nullptr;
+            unsigned                                m_cqMask = 0;
+            io_uring_cqe                           *m_cqes = nullptr;
+            std::vector<write>                      m_writes;       //!< by buffer
+            std::vector<std::pair<unsigned, bool>>  m_finished;     //!< buffers written without the ring, and if it worked
+    };
+
+    //! Writes with `pwrite()` from a few threads of its own
+    class logAsyncFile::threadEngine : public engine
+    {
+        public:
+            threadEngine(int fd, unsigned threads)
+                : m_fd(fd)
+                , m_stop(false)
+                , m_failed(0)
+            {
+                for(unsigned t = 0; t < threads; ++t)
+                {
+                    m_threads.emplace_back(&threadEngine::run, this);
+                }
+            }
+
+            ~threadEngine()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+
+                m_work.notify_all();
+
+                for(auto &thread : m_threads)
+                {
+                    thread.join();
+                }
+            }
+
+            void submit(unsigned buffer, const char *data, size_t length, uint64_t offset) override
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_jobs.push_back({buffer, data, length, offset});
+                }
+
+                m_work.notify_one();
+            }
+
+            void complete(bool wait, std::vector<unsigned> &free, uint64_t &errors) override
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                if(wait)
+                {
+                    m_done.wait(lock, [this]{ return !m_finished.empty(); });
+                }
+
+                free.insert(free.end(), m_finished.begin(), m_finished.end());
+                m_finished.clear();
+                errors += m_failed;
+                m_failed = 0;
+            }
+
+        private:
+            //! A write waiting for a thread
+            struct job
+            {
+                unsigned    buffer;
+                const char *data;
+                size_t      length;
+                uint64_t    offset;
+            };
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                while(true)
+                {
+                    m_work.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+
+                    if(m_jobs.empty())
+                    {
+                        break;
+                    }
+
+                    auto next(m_jobs.front());
+                    m_jobs.pop_front();
+                    lock.unlock();
+
+                    bool written(pwriteAll(m_fd, next.data, next.length, next.offset));
+
+                    lock.lock();
+                    m_finished.push_back(next.buffer);
+                    m_failed += written ? 0 : 1;
+                    m_done.notify_one();
+                }
+            }
+
+            int                         m_fd;
+            std::mutex                  m_mutex;
+            std::condition_variable     m_work;
+            std::condition_variable     m_done;
+            std::deque<job>             m_jobs;
+            std::vector<unsigned>       m_finished;
+            bool                        m_stop;
+            uint64_t                    m_failed;
+            std::vector<std::thread>    m_threads;
+    };
+
+    logAsyncFile::logAsyncFile(const boost::filesystem::path &logFile)
+        : logAsyncFile(logFile, asyncPolicy())
+    {
+    }
+
+    logAsyncFile::logAsyncFile(const boost::filesystem::path &logFile, const asyncPolicy &policy)
+        : m_fd(-1)
+        , m_policy(policy)
+        , m_direct(false)
+        , m_uring(false)
+        , m_memory(nullptr, std::free)
+        , m_appender(m_staging)
+        , m_stream(&m_appender)
+        , m_offset(0)
+        , m_written(0)
+        , m_tailInFlight(false)
+        , m_tailBuffer(0)
+        , m_tailEnd(0)
+        , m_tailWanted(false)
+        , m_errors(0)
+    {
+        m_policy.bufferSize = std::max((m_policy.bufferSize + directBlock - 1) & ~(directBlock - 1), directBlock);
+        m_policy.buffers = std::max(m_policy.buffers, 1u);
+        m_policy.threads = std::max(m_policy.threads, 1u);
+
+        if(m_policy.direct)
+        {
+            // Fails with EINVAL where the file system can't do it
+            m_fd = ::open(logFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+            m_direct = m_fd >= 0;
+        }
+
+        if(m_fd < 0)
+        {
+            m_fd = openLog(logFile);
+        }
+
+        void *memory(nullptr);
+
+        if(m_fd < 0 || ::posix_memalign(&memory, directBlock, m_policy.bufferSize * m_policy.buffers) != 0)
+        {
+            return;
+        }
+
+        m_memory.reset(static_cast<char *>(memory));
+
+        for(unsigned buffer = m_policy.buffers; buffer > 0; --buffer)
+        {
+            m_free.push_back(buffer - 1);
+        }
+
+        if(m_policy.uring)
+        {
+            auto uring(std::make_unique<uringEngine>(m_fd, m_policy.buffers));
+
+            if(uring->valid())
+            {
+                m_engine = std::move(uring);
+                m_uring = true;
+            }
+        }
+
+        if(!m_engine)
+        {
+            m_engine = std::make_unique<threadEngine>(m_fd, m_policy.threads);
+        }
+
+        m_staging.reserve(m_policy.bufferSize + 1024);
+    }
+
+    logAsyncFile::~logAsyncFile()
+    {
+        if(m_engine)
+        {
+            Flush();
+            drain();
+            m_engine.reset();
+        }
+
+        if(m_fd >= 0)
+        {
+            closeLog(m_fd);
+        }
+    }
+
+    void logAsyncFile::LogMessage(std::shared_ptr<message> msg)
+    {
+        if(!m_engine)
+        {
+            return;
+        }
+
+        if(m_staging.size() == m_written)
+        {
+            m_oldest = std::chrono::steady_clock::now();
+        }
+
+        append(*msg);
+
+        if(msg->getLevel() <= m_policy.immediateLevel)
+        {
+            Flush();
+        }
+        else if(m_staging.size() >= m_policy.bufferSize)
+        {
+            submitFull();
+        }
+    }
+
+    void logAsyncFile::LogMessages(const std::vector<std::shared_ptr<message>> &messages)
+    {
+        if(!m_engine || messages.empty())
+        {
+            return;
+        }
+
+        if(m_staging.size() == m_written)
+        {
+            m_oldest = std::chrono::steady_clock::now();
+        }
+
+        bool immediate(false);
+
+        for(const auto &msg : messages)
+        {
+            append(*msg);
+            immediate |= msg->getLevel() <= m_policy.immediateLevel;
+
+            if(m_staging.size() >= m_policy.bufferSize)
+            {
+                submitFull();
+            }
+        }
+
+        if(immediate)
+        {
+            Flush();
+        }
+    }
+
+    void logAsyncFile::append(const message &msg)
+    {
+        m_header.render(msg, m_staging);
+        m_staging.push_back(' ');
+        m_stream << msg.getMessageBody() << '\n';
+    }
+
+    void logAsyncFile::Idle()
+    {
+        if(!m_engine)
+        {
+            return;
+        }
+
+        if(m_free.size() < m_policy.buffers)
+        {
+            reap(false);
+        }
+
+        if(m_staging.size() > m_written &&
+           ((m_tailWanted && !m_tailInFlight) || std::chrono::steady_clock::now() - m_oldest >= m_policy.interval))
+        {
+            Flush();
+        }
+    }
+
+    void logAsyncFile::Flush()
+    {
+        if(!m_engine)
+        {
+            return;
+        }
+
+        m_tailWanted = false;
+        submitFull();
+
+        if(!m_direct)
+        {
+            if(!m_staging.empty())
+            {
+                submit(m_staging.data(), m_staging.size(), m_offset);
+                m_offset += m_staging.size();
+                m_staging.clear();
+            }
+
+            return;
+        }
+
+        // O_DIRECT, whole blocks go as they are
+        size_t whole(m_staging.size() & ~(directBlock - 1));
+
+        if(whole > 0)
+        {
+            submit(m_staging.data(), whole, m_offset);
+            m_offset += whole;
+            m_staging.erase(0, whole);
+            m_written = 0;
+        }
+
+        if(m_staging.size() > m_written)
+        {
+            submitTail();
+        }
+    }
+
+    void logAsyncFile::submitFull()
+    {
+        size_t position(0);
+
+        while(m_staging.size() - position >= m_policy.bufferSize)
+        {
+            submit(m_staging.data() + position, m_policy.bufferSize, m_offset);
+            m_offset += m_policy.bufferSize;
+            position += m_policy.bufferSize;
+        }
+
+        if(position > 0)
+        {
+            m_staging.erase(0, position);
+            m_written = 0;
+        }
+    }
+
+    void logAsyncFile::submit(const char *data, size_t length, uint64_t offset)
+    {
+        unsigned buffer(fill(data, length, length));
+
+        if(m_tailInFlight)
+        {
+            // It would overwrite the padded block, or be cut off by the truncate that follows it
+            m_held.push_back({buffer, length, offset});
+            return;
+        }
+
+        m_engine->submit(buffer, memory(buffer), length, offset);
+    }
+
+    void logAsyncFile::submitTail()
+    {
+        if(m_tailInFlight)
+        {
+            // Two writes of the same block could land in either order, Idle() writes it again once this one is done
+            m_tailWanted = true;
+            return;
+        }
+
+        size_t padded((m_staging.size() + directBlock - 1) & ~(directBlock - 1));
+
+        m_tailBuffer = fill(m_staging.data(), m_staging.size(), padded);
+        m_tailEnd = m_offset + m_staging.size();
+        m_tailInFlight = true;
+        m_written = m_staging.size();
+
+        m_engine->submit(m_tailBuffer, memory(m_tailBuffer), padded, m_offset);
+    }
+
+    unsigned logAsyncFile::fill(const char *data, size_t length, size_t writeLength)
+    {
+        while(m_free.empty())
+        {
+            reap(true);
+        }
+
+        unsigned buffer(m_free.back());
+        m_free.pop_back();
+
+        std::memcpy(memory(buffer), data, length);
+
+        if(writeLength > length)
+        {
+            std::memset(memory(buffer) + length, 0, writeLength - length);
+        }
+
+        return buffer;
+    }
+
+    void logAsyncFile::reap(bool wait)
+    {
+        size_t first(m_free.size());
+
+        m_engine->complete(wait, m_free, m_errors);
+
+        if(!m_tailInFlight || std::find(m_free.begin() + first, m_free.end(), m_tailBuffer) == m_free.end())
+        {
+            return;
+        }
+
+        // The padded block has landed, cut the padding off and let the writes behind it go. None of them can be in
+        // flight yet, so the file ends with the padded block.
+        m_tailInFlight = false;
+
+        if(::ftruncate(m_fd, static_cast<off_t>(m_tailEnd)) != 0)
+        {
+            ++m_errors;
+        }
+
+        for(const auto &held : m_held)
+        {
+            m_engine->submit(held.buffer, memory(held.buffer), held.length, held.offset);
+        }
+
+        m_held.clear();
+    }
+
+    void logAsyncFile::drain()
+    {
+        while(m_free.size() < m_policy.buffers || m_tailWanted)
+        {
+            if(m_tailWanted && !m_tailInFlight)
+            {
+                Flush();
+                continue;
+            }
+
+            reap(true);
+        }
+    }
+#endif
+}
@@ -16,8 +16,12 @@
 #include <system_error>
 #include <queue>
 #include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include "date/date.h"
 #include "log_message.h"
@@ -28,7 +32,33 @@ namespace LogXX
     class logTarget
     {
         public:
+            virtual ~logTarget() = default;
+
             virtual void LogMessage(std::shared_ptr<message> msg) = 0; //!< Log message to back end
+
+            //! Log a batch of messages, oldest first
+            //! \note The manager hands over everything it drained from the queue in one go, override this when a back end can
+            //!       do better than one message at a time
+            virtual void LogMessages(const std::vector<std::shared_ptr<message>> &messages)
+            {
+                for(const auto &msg : messages)
+                {
+                    LogMessage(msg);
+                }
+            }
+
+            virtual void Idle() {}                                      //!< Log thread has run out of messages for now
+            virtual void Flush() {}                                     //!< Write out anything being held back, called on Shutdown
+
+            //! Choose how this back end lays out message headers, call before the manager is running
+            //! \param[in] formatStr header format string, see message::getMessageHeader() for the fields
+            void setHeaderFormat(const std::string &formatStr)
+            {
+                m_header = headerLayout(formatStr);
+            }
+
+        protected:
+            headerLayout m_header;                                      //!< Header layout, message::defaultHeaderFormat unless set
     };
 
     //! Log back end that sends log messages to `std::clog` stream
@@ -38,32 +68,345 @@ namespace LogXX
             //! Log message to `std::clog`
             void LogMessage(std::shared_ptr<message> msg) override
             {
-                std::clog << msg << std::endl;
+                m_line.clear();
+                m_header.render(*msg, m_line);
+                std::clog << m_line << ' ' << msg->getMessageBody() << '\n';
             }
 
+        private:
+            std::string m_line;                                         //!< header text, reused between messages
     };
 
     //! Log back end that sends log messages to a file
+    //! \details Messages are collected in a buffer and written with as few system calls as possible, see flushPolicy.
+    //!          Whatever is still buffered is written by Flush(), when the manager shuts down, or when the target is destroyed.
+    //!
+    //!          The file can be rotated on size or time, see rotationPolicy. When it is due, the file is closed, renamed to
+    //!          `<file>.<YYYYmmdd-HHMMSS>` (UTC, when it was closed) and a new file is opened, all between two writes on
+    //!          the log thread. Compressing closed segments and deleting old ones happens on a low priority thread of its
+    //!          own, the log thread never waits for it.
     class logFile : public logTarget
     {
         public:
-            logFile(const boost::filesystem::path logFile) : m_file(logFile)
+            //! When buffered messages are written to the file
+            struct flushPolicy
             {
+                size_t                      bufferSize     = 64 * 1024;                      //!< write once this many bytes are waiting, 0 writes every message
+                std::chrono::milliseconds   interval       = std::chrono::milliseconds(1000); //!< longest a message waits in the buffer
+                levels                      immediateLevel = LOG_ERR;                        //!< write at once for messages this severe or worse
+            };
 
-            }
+            //! When the file is closed and a new one started, and what happens to the closed ones
+            //! \note A file is never rotated while it is empty, and a write is never split between two files, so a file
+            //!       only grows past `maxSize` when a single write is bigger than that
+            struct rotationPolicy
+            {
+                uintmax_t                   maxSize  = 0;                          //!< start a new file before it grows past this many bytes, 0 for no limit
+                std::chrono::seconds        interval = std::chrono::seconds(0);    //!< start a new file on multiples of this since the epoch, 0 never
+                unsigned                    keep     = 0;                          //!< closed files to keep, older ones are deleted, 0 keeps them all
+                bool                        compress = false;                      //!< gzip closed files, `<file>.<YYYYmmdd-HHMMSS>.gz`
+            };
+
+            logFile(const boost::filesystem::path logFile);
+            logFile(const boost::filesystem::path logFile, const flushPolicy &policy);
+            logFile(const boost::filesystem::path logFile, const flushPolicy &policy, const rotationPolicy &rotation);
+
+            //! Log file described by a `backend` configuration node, see configuration::getBackends()
+            //! \details Reads `file`, and optionally `rotate_size` (bytes, `K`, `M` or `G` suffix), `rotate_interval`
+            //!          (seconds, `s`, `m`, `h` or `d` suffix), `keep` and `compress`
+            //! \throw std::invalid_argument if the node has no `file` or a value can't be read
+            explicit logFile(const boost::property_tree::ptree &backend);
+            ~logFile();
+
+            logFile(const logFile &) = delete;
+            logFile &operator=(const logFile &) = delete;
 
             //! Log message to file
-            void LogMessage(std::shared_ptr<message> msg) override
+            void LogMessage(std::shared_ptr<message> msg) override;
+
+            //! Log a batch of messages to file, writing once for every buffer full
+            void LogMessages(const std::vector<std::shared_ptr<message>> &messages) override;
+
+            //! Write the buffer if it has been waiting longer than the flush interval
+            void Idle() override;
+
+            //! Write the buffer
+            void Flush() override;
+
+        private:
+            class archiver;
+
+            //! Format a message into m_buffer
+            void append(const message &msg);
+
+            //! True if the file should be rotated before writing `pending` more bytes
+            bool rotationDue(size_t pending);
+
+            //! Close the file, hand it to the archiver and open a new one
+            void rotate();
+
+            //! Move the file to its closed name, `<file>.<YYYYmmdd-HHMMSS>`, made unique with a `.N` suffix if needed
+            //! \return the new name, empty if the file couldn't be moved
+            boost::filesystem::path closeSegment();
+
+            int                                     m_fd;
+            flushPolicy                             m_policy;
+            std::string                             m_buffer;
+            appendBuffer                            m_appender;
+            std::ostream                            m_stream;       //!< formats messages into m_buffer
+            std::chrono::steady_clock::time_point   m_oldest;       //!< when the first message in m_buffer was added
+            boost::filesystem::path                 m_path;
+            rotationPolicy                          m_rotation;
+            uintmax_t                               m_written;      //!< bytes written to the current file
+            std::chrono::system_clock::time_point   m_nextRotation; //!< next time boundary, with a rotation interval
+            std::unique_ptr<archiver>               m_archiver;     //!< compresses and prunes closed files, with rotation
+    };
+
+    //! Log back end that writes a compact binary record stream to a file
+    //! \note No dates, thread IDs or paths are formatted when logging, use `logxx-decode` to turn the file back into text.
+    //!       See log_binary.h for the record layout.
+    class logBinary : public logTarget
+    {
+        public:
+            logBinary(const boost::filesystem::path logFile);
+
+            //! Log message to file
+            void LogMessage(std::shared_ptr<message> msg) override;
+
+            //! Log a batch of messages to file as one block of records
+            void LogMessages(const std::vector<std::shared_ptr<message>> &messages) override;
+
+        private:
+            //! Add the records for a message, and any dictionary entries it needs, to m_record
+            void appendRecord(const std::shared_ptr<message> &msg);
+
+            boost::filesystem::ofstream                     m_file;
+            std::string                                     m_record;     //!< record being built, reused between messages
+            std::unordered_set<uint64_t>                    m_callsites;  //!< call sites already in the stream
+            std::unordered_map<std::thread::id, uint32_t>   m_threads;    //!< threads already in the stream
+    };
+
+#ifndef _WIN32
+    //! Fixed size ring of the most recent log messages, kept in a memory mapped file
+    //! \details Every message the manager sees is recorded, including ones the configuration filters out, so the ring
+    //!          holds the full story leading up to a crash. The ring lives in the page cache, whatever was written
+    //!          survives the process dying on a signal. When a ring file left by a previous run is opened, its contents are
+    //!          saved as text next to it, in `<ring file>.last`, before the ring is reset.
+    class logRing : public logTarget
+    {
+        public:
+            //! Map a ring of `capacity` bytes backed by `ringFile`
+            //! \note Capacities under 4 KiB are raised to 4 KiB, a single message may take up to a quarter of the ring
+            logRing(const boost::filesystem::path &ringFile, size_t capacity = 4 * 1024 * 1024);
+            ~logRing();
+
+            logRing(const logRing &) = delete;
+            logRing &operator=(const logRing &) = delete;
+
+            //! Record message in the ring
+            //! \note Called from the log thread and from threads logging messages only the ring keeps, the text is rendered
+            //!       before taking the lock so the lock only covers the copy
+            void LogMessage(std::shared_ptr<message> msg) override;
+
+            //! Replay the ring, oldest message first, to another log back end
+            //! \note Only valid in the process that wrote the ring, messages refer to call sites by address
+            void Dump(logTarget &target);
+
+            //! Write the ring as text to a file descriptor
+            //! \note Only uses `write()`, no locks and no allocations, safe to call from a fatal signal handler
+            void Dump(int fd) const;
+
+        private:
+            struct ringHeader;
+            struct recordHeader;
+
+            //! Copy bytes in to or out of the ring, wrapping at the end
+            void copyIn(uint64_t position, const void *data, size_t length);
+            void copyOut(uint64_t position, void *data, size_t length) const;
+
+            int          m_fd;
+            size_t       m_mapSize;
+            ringHeader  *m_ring;
+            char        *m_data;
+            uint64_t     m_capacity;
+            std::mutex   m_mutex;       //!< serialises LogMessage and Dump(logTarget &)
+    };
+
+    //! Log back end that copies messages straight into a memory mapped file
+    //! \details The file is mapped a chunk at a time. Logging a message is a copy into the mapping, disk space for the
+    //!          chunk is reserved up front so a full disk fails the remap rather than a copy with `SIGBUS`, and the file
+    //!          is grown into the chunk `growStep` at a time, so logging makes a system call once a megabyte. Written
+    //!          pages are handed to the kernel with `msync(MS_ASYNC)` at most once an interval. Messages are in the page
+    //!          cache as soon as they are logged, other processes reading the file see them at once and they survive
+    //!          the process crashing.
+    //! \note While the file is open it ends up to `growStep`, or the end of the chunk if that is nearer, past the newest
+    //!       message and readers see zeros after it. The file is cut back to the messages when the target is destroyed.
+    class logMappedFile : public logTarget
+    {
+        public:
+            //! \param[in] logFile file to write, replaced if it exists
+            //! \param[in] chunkSize how much disk space is reserved and how much is mapped at once, rounded up to whole pages
+            //! \param[in] syncInterval longest time written pages wait before they are queued for writing back
+            logMappedFile(const boost::filesystem::path &logFile, size_t chunkSize = 64 * 1024 * 1024,
+                          std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000));
+            ~logMappedFile();
+
+            logMappedFile(const logMappedFile &) = delete;
+            logMappedFile &operator=(const logMappedFile &) = delete;
+
+            //! Copy message into the file
+            void LogMessage(std::shared_ptr<message> msg) override;
+
+            //! Queue written pages for writing back if the sync interval has passed
+            void Idle() override;
+
+            //! Queue written pages for writing back
+            void Flush() override;
+
+        private:
+            //! Map the chunk that the next `length` bytes go in, reserving disk space for it
+            bool remap(size_t length);
+
+            //! Grow the file past `end` by up to `growStep`, within the reserved space
+            bool grow(uint64_t end);
+
+            static constexpr uint64_t growStep = 1024 * 1024;  //!< how far the end of the file moves at once
+
+            int                                     m_fd;
+            size_t                                  m_chunkSize;
+            std::chrono::milliseconds               m_syncInterval;
+            char                                   *m_map;
+            uint64_t                                m_mapOffset;    //!< file offset of the start of the mapping
+            size_t                                  m_mapSize;
+            uint64_t                                m_position;     //!< file offset of the next message
+            uint64_t                                m_synced;       //!< file offset up to which pages have been synced
+            uint64_t                                m_fileSize;
+            uint64_t                                m_reserved;     //!< file offset up to which disk space is reserved
+            size_t                                  m_page;
+            std::chrono::steady_clock::time_point   m_lastSync;
+            std::string                             m_text;         //!< text of the message being logged, reused
+            appendBuffer                            m_appender;
+            std::ostream                            m_stream;       //!< formats message bodies into m_text
+    };
+#endif
+
+#ifdef __linux__
+    //! Log back end that writes to a file without waiting for the disk
+    //! \details Messages are collected into fixed size buffers, full buffers are handed to the kernel through io_uring and
+    //!          the log thread carries on with the next one, several writes can be in flight at once. Where io_uring isn't
+    //!          available, or is switched off, a few writer threads call `pwrite()` instead. The log thread only waits
+    //!          when every buffer is in flight.
+    //!
+    //!          With `direct` the file is opened with `O_DIRECT`, bypassing the page cache. Whole buffers are written as
+    //!          they fill, a partial buffer is written padded to the block size and the file is cut back to the real
+    //!          length once that write has finished. Writes made while it is in flight are held back until then, so the
+    //!          log thread never waits for the padded block. File systems without `O_DIRECT`, tmpfs for one, get normal
+    //!          writes.
+    //! \note Writes can complete out of order, a reader following the file may briefly see a gap that an earlier write
+    //!       hasn't filled in yet. Everything is written by the time the target is destroyed.
+    class logAsyncFile : public logTarget
+    {
+        public:
+            //! How buffers are written
+            struct asyncPolicy
             {
-                if(m_file.is_open())
-                {
-                    m_file << msg << std::endl;
-                }
-            }
+                size_t                      bufferSize     = 256 * 1024;                     //!< bytes per write, rounded up to a multiple of 4096
+                unsigned                    buffers        = 4;                              //!< buffers, and so writes that can be in flight
+                std::chrono::milliseconds   interval       = std::chrono::milliseconds(1000); //!< longest a message waits before it is written
+                levels                      immediateLevel = LOG_ERR;                        //!< write at once for messages this severe or worse
+                bool                        direct         = false;                          //!< bypass the page cache with `O_DIRECT`
+                bool                        uring          = true;                           //!< use io_uring if the kernel allows, false always uses threads
+                unsigned                    threads        = 2;                              //!< writer threads when io_uring isn't used
+            };
+
+            logAsyncFile(const boost::filesystem::path &logFile);
+            logAsyncFile(const boost::filesystem::path &logFile, const asyncPolicy &policy);
+            ~logAsyncFile();
+
+            logAsyncFile(const logAsyncFile &) = delete;
+            logAsyncFile &operator=(const logAsyncFile &) = delete;
+
+            //! Log message to file
+            void LogMessage(std::shared_ptr<message> msg) override;
+
+            //! Log a batch of messages to file
+            void LogMessages(const std::vector<std::shared_ptr<message>> &messages) override;
+
+            //! Collect finished writes, and write the buffer if it has been waiting longer than the interval
+            void Idle() override;
+
+            //! Start writing whatever is buffered
+            void Flush() override;
+
+            bool     usingUring()  const { return m_uring; }       //!< True if writes go through io_uring
+            bool     usingDirect() const { return m_direct; }      //!< True if the file was opened with `O_DIRECT`
+            uint64_t getErrors()   const { return m_errors; }      //!< Writes that failed
 
         private:
-            boost::filesystem::ofstream m_file;
+            class engine;
+            class uringEngine;
+            class threadEngine;
+
+            //! A filled buffer waiting for the padded last block to land
+            struct heldWrite
+            {
+                unsigned    buffer;
+                size_t      length;
+                uint64_t    offset;
+            };
+
+            //! Format a message into m_staging
+            void append(const message &msg);
+
+            //! Write every full buffer waiting in m_staging
+            void submitFull();
+
+            //! Start writing `length` bytes at `offset`, held back while the padded last block is in flight
+            void submit(const char *data, size_t length, uint64_t offset);
+
+            //! Start writing m_staging padded to a whole block, with `O_DIRECT`
+            //! \note Only one padded write is in flight at a time, if there is one already another follows when it finishes
+            void submitTail();
+
+            //! Copy `length` bytes into a free buffer, padded with zeros to `writeLength`
+            //! \return the buffer
+            unsigned fill(const char *data, size_t length, size_t writeLength);
+
+            //! Start of buffer number `buffer`
+            char *memory(unsigned buffer) const
+            {
+                return m_memory.get() + buffer * m_policy.bufferSize;
+            }
+
+            //! Collect finished writes, if `wait` block until there is at least one
+            //! \details Once the padded last block has landed the file is cut back to its real length and the writes held
+            //!          back behind it are started.
+            void reap(bool wait);
+
+            //! Wait for every write in flight
+            void drain();
+
+            int                                     m_fd;
+            asyncPolicy                             m_policy;
+            bool                                    m_direct;
+            bool                                    m_uring;
+            std::unique_ptr<char, void (*)(void *)> m_memory;       //!< the buffers, aligned for `O_DIRECT`
+            std::vector<unsigned>                   m_free;         //!< buffers not in flight
+            std::unique_ptr<engine>                 m_engine;
+            std::string                             m_staging;      //!< formatted text not yet handed to a buffer
+            appendBuffer                            m_appender;
+            std::ostream                            m_stream;       //!< formats messages into m_staging
+            uint64_t                                m_offset;       //!< file offset of the start of m_staging
+            size_t                                  m_written;      //!< bytes of m_staging written padded, with `O_DIRECT`
+            bool                                    m_tailInFlight; //!< a padded write of the last block hasn't finished
+            unsigned                                m_tailBuffer;   //!< the buffer it was made from
+            uint64_t                                m_tailEnd;      //!< real length of the file once it has landed
+            bool                                    m_tailWanted;   //!< m_staging has grown since, write it again after
+            std::vector<heldWrite>                  m_held;         //!< writes waiting for it
+            std::chrono::steady_clock::time_point   m_oldest;       //!< when the first message in m_staging was added
+            uint64_t                                m_errors;
     };
+#endif
 
 #ifdef _WIN32
     //! Log back end that sends log messages to `::OutputDebugString()`